@@ -20,6 +20,9 @@
 
 #define REALLOC_TRACEFILES "realloc-bal.rep", "realloc2-bal.rep"
 
+/* Same-size nodes allocated and freed in groups; see mdriver -b */
+#define BATCH_TRACEFILES "batch-bal.rep"
+
 typedef struct trace_baseline_t {
   const char *name; /* trace name */
   const int consistent;
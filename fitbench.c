@@ -0,0 +1,337 @@
+/*
+ * fitbench.c - times a first-fit search of one size class done by walking
+ * the class's free list against the same search done by scanning the class's
+ * size index (see SIZE_INDEX in mminline.h), and counts the cache misses of
+ * each where the kernel lets it.
+ *
+ * The free blocks and the requests get their sizes from the allocation
+ * requests of trace files (by default the random traces). Those draw sizes
+ * uniformly up to about 32KB, so most would be large blocks; sizes are taken
+ * modulo LARGE_BLOCK_SIZE to land them in the lists instead. The blocks are
+ * scattered over a region much bigger than the caches, so each step of a
+ * list walk touches a new cache line, as it would in a fragmented heap.
+ *
+ * With -c, the caches are flushed before every search, which is how a search
+ * in a heap that the program has been busy elsewhere starts out.
+ *
+ * usage: fitbench [-f <file>] [-s <searches>] [-c]
+ */
+#define SIZE_INDEX 1
+
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./mm.h"
+#include "./mminline.h"
+
+#define MAXLINE 1024
+#define MAX_TRACES 8
+#define REGION_SIZE (64L << 20) /* bytes the free blocks are scattered over */
+#define SLOT_SIZE 4096          /* each free block starts its own page */
+#define FLUSH_SIZE (32L << 20)  /* bytes read to flush the caches */
+
+typedef struct {
+    long *sizes; /* block sizes, including tags */
+    int num_sizes;
+} pool_t;
+
+typedef struct {
+    double secs;   /* time spent searching */
+    long misses;   /* cache misses while searching, or -1 if not counted */
+    long probes;   /* blocks (walk) or groups of 8 sizes (scan) looked at */
+    long searches; /* searches run */
+} result_t;
+
+static free_index_t bench_index;
+static char *region;
+static char *flush_buf;
+static int miss_fd = -1; /* perf event counting cache misses, or -1 */
+
+static void app_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+/* adds the block sizes of a trace's alloc and realloc requests to pool */
+static void read_sizes(char *path, pool_t *pool) {
+    FILE *f;
+    char type[MAXLINE];
+    int heap_size, num_ids, num_ops, weight, index, size;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    if (fscanf(f, "%d %d %d %d", &heap_size, &num_ids, &num_ops, &weight) != 4)
+        app_error("malformed trace header");
+    pool->sizes =
+        realloc(pool->sizes, (pool->num_sizes + num_ops) * sizeof(long));
+    if (pool->sizes == NULL) app_error("realloc failed in read_sizes");
+
+    for (int i = 0; i < num_ops; i++) {
+        if (fscanf(f, "%s", type) != 1) app_error("truncated trace");
+        if (type[0] == 'f') {
+            if (fscanf(f, "%d", &index) != 1) app_error("malformed request");
+            continue;
+        }
+        if (fscanf(f, "%d %d", &index, &size) != 2)
+            app_error("malformed request");
+        /* the size of the block mm_malloc would look for, kept in the lists */
+        long bsize =
+            (size % LARGE_BLOCK_SIZE + ALIGNMENT - 1) & ~(long)(ALIGNMENT - 1);
+        bsize += ALLOC_TAGS_SIZE;
+        if (bsize < MINBLOCKSIZE) bsize = MINBLOCKSIZE;
+        if (bsize >= LARGE_BLOCK_SIZE) bsize = LARGE_BLOCK_SIZE - ALIGNMENT;
+        pool->sizes[pool->num_sizes++] = bsize;
+    }
+    fclose(f);
+}
+
+/* opens a counter of the calling thread's cache misses, if allowed */
+static void open_miss_counter(void) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    miss_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* reads every cache line of a buffer bigger than the caches */
+static void flush_caches(void) {
+    volatile char *p = flush_buf;
+    for (long i = 0; i < FLUSH_SIZE; i += 64) {
+        (void)p[i];
+    }
+}
+
+/* empties the index and fills every class with up to n free blocks drawn
+ * from pool, each at its own randomly chosen page of the region */
+static void fill_index(pool_t *pool, int n) {
+    int num_slots = REGION_SIZE / SLOT_SIZE;
+    int *slots = malloc(num_slots * sizeof(int));
+    int full = 0;
+
+    if (slots == NULL) app_error("malloc failed in fill_index");
+    for (int i = 0; i < num_slots; i++) {
+        slots[i] = i;
+    }
+    for (int i = num_slots - 1; i > 0; i--) { /* shuffles the pages */
+        int j = rand() % (i + 1);
+        int tmp = slots[i];
+        slots[i] = slots[j];
+        slots[j] = tmp;
+    }
+    memset(&bench_index, 0, sizeof(bench_index));
+    bench_index.base = region;
+
+    int used = 0;
+    for (int tries = 0; tries < 64 * n * NUM_SIZE_CLASSES; tries++) {
+        long size = pool->sizes[rand() % pool->num_sizes];
+        int class = size_class(size);
+        if (bench_index.index_count[class] == n) {
+            continue;
+        }
+        block_t *b = (block_t *)(region + (long)slots[used++] * SLOT_SIZE);
+        block_set_size_and_allocated(b, size, 0);
+        insert_free_block(b);
+        if (bench_index.index_count[class] == n && ++full == NUM_SIZE_CLASSES)
+            break;
+    }
+    free(slots);
+}
+
+/* the first block on class's list with at least size bytes, or NULL */
+static block_t *walk_fit(int class, long size, long *probes) {
+    block_t *start = findex->flist_first[class];
+    block_t *cur = start;
+    do {
+        (*probes)++;
+        if (block_size(cur) >= size) {
+            return cur;
+        }
+        cur = block_flink(cur);
+    } while (cur != start);
+    return NULL;
+}
+
+/* the same block as walk_fit, found from class's size index */
+static block_t *scan_fit(int class, long size, long *probes) {
+    int *sizes = findex->index_size[class];
+    for (int chunk = (findex->index_count[class] - 1) & ~7; chunk >= 0;
+         chunk -= 8) {
+        (*probes)++;
+        unsigned int mask = size_index_fits(&sizes[chunk], size);
+        if (mask != 0) { /* the last fit is the one nearest the list head */
+            int i = chunk + 31 - __builtin_clz(mask);
+            return (block_t *)(findex->base + findex->index_offset[class][i]);
+        }
+    }
+    return NULL;
+}
+
+/* runs the searches in sizes with fit, flushing the caches before each one
+ * if cold is set. Warm searches are timed all together, since each takes
+ * about as long as reading the clock. */
+static result_t run(block_t *(*fit)(int, long, long *), long *sizes,
+                    int num_searches, int cold, block_t **found) {
+    result_t r = {0, miss_fd < 0 ? -1 : 0, 0, 0};
+    struct timespec start, end;
+
+    if (miss_fd >= 0) ioctl(miss_fd, PERF_EVENT_IOC_RESET, 0);
+    if (!cold) {
+        if (miss_fd >= 0) ioctl(miss_fd, PERF_EVENT_IOC_ENABLE, 0);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+    for (int i = 0; i < num_searches; i++) {
+        int class = size_class(sizes[i]);
+        if (findex->flist_first[class] == NULL) {
+            continue;
+        }
+        if (cold) {
+            flush_caches();
+            if (miss_fd >= 0) ioctl(miss_fd, PERF_EVENT_IOC_ENABLE, 0);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+        found[i] = fit(class, sizes[i], &r.probes);
+        if (cold) {
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (miss_fd >= 0) ioctl(miss_fd, PERF_EVENT_IOC_DISABLE, 0);
+            r.secs += (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec) / 1e9;
+        }
+        r.searches++;
+    }
+    if (!cold) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (miss_fd >= 0) ioctl(miss_fd, PERF_EVENT_IOC_DISABLE, 0);
+        r.secs =
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    }
+    if (miss_fd >= 0 && read(miss_fd, &r.misses, sizeof(long)) != sizeof(long))
+        r.misses = -1;
+    return r;
+}
+
+/* prints the per-search cost of r under a column for each of its numbers */
+static void print_result(result_t r) {
+    printf("%-9.1f ", r.secs / r.searches * 1e9);
+    if (r.misses < 0) {
+        printf("%-8s ", "n/a");
+    } else {
+        printf("%-8.2f ", (double)r.misses / r.searches);
+    }
+    printf("%-7.2f ", (double)r.probes / r.searches);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: fitbench [-f <file>] [-s <searches>] [-c]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr,
+            "\t-f <file>  Trace file to take sizes from (can be repeated;\n"
+            "\t           default: the random traces).\n");
+    fprintf(
+        stderr,
+        "\t-s <n>     Searches per run (default 100000, or 2000 with -c).\n");
+    fprintf(stderr, "\t-c         Flush the caches before every search.\n");
+}
+
+int main(int argc, char **argv) {
+    char *paths[MAX_TRACES];
+    int num_paths = 0;
+    int num_searches = 0; /* 0: the default for the cache mode */
+    int cold = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:s:ch")) != EOF) {
+        switch (c) {
+            case 'f':
+                if (num_paths == MAX_TRACES) app_error("too many traces");
+                paths[num_paths++] = optarg;
+                break;
+            case 's':
+                num_searches = atoi(optarg);
+                break;
+            case 'c':
+                cold = 1;
+                break;
+            default:
+                usage();
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (num_searches ==
+        0) { /* every cold search reads FLUSH_SIZE bytes first */
+        num_searches = cold ? 2000 : 100000;
+    }
+    if (num_searches < 1) {
+        usage();
+        exit(1);
+    }
+    if (num_paths == 0) {
+        paths[num_paths++] = "./traces/random-bal.rep";
+        paths[num_paths++] = "./traces/random2-bal.rep";
+    }
+
+    pool_t pool = {NULL, 0};
+    for (int i = 0; i < num_paths; i++) {
+        read_sizes(paths[i], &pool);
+    }
+    if (pool.num_sizes == 0) app_error("no alloc requests in the traces");
+
+    long *sizes = malloc(num_searches * sizeof(long));
+    block_t **walked = malloc(num_searches * sizeof(block_t *));
+    block_t **scanned = malloc(num_searches * sizeof(block_t *));
+    region = malloc(REGION_SIZE);
+    flush_buf = malloc(FLUSH_SIZE);
+    if (sizes == NULL || walked == NULL || scanned == NULL || region == NULL ||
+        flush_buf == NULL)
+        app_error("malloc failed in main");
+    memset(region, 0, REGION_SIZE);
+    memset(flush_buf, 1, FLUSH_SIZE);
+    srand(1);
+    for (int i = 0; i < num_searches; i++) {
+        sizes[i] = pool.sizes[rand() % pool.num_sizes];
+    }
+    findex = &bench_index;
+    open_miss_counter();
+
+    printf("%d sizes from %d trace(s), %d searches, %s caches\n",
+           pool.num_sizes, num_paths, num_searches, cold ? "cold" : "warm");
+    printf("%-9s%-27s%s\n", "", "list walk", "size index");
+    printf("blocks   ns        misses   probes  ns        misses   probes\n");
+    for (int n = 1; n <= SIZE_INDEX_SLOTS; n *= 2) {
+        fill_index(&pool, n);
+        memset(walked, 0, num_searches * sizeof(block_t *));
+        memset(scanned, 0, num_searches * sizeof(block_t *));
+        result_t walk = run(walk_fit, sizes, num_searches, cold, walked);
+        result_t scan = run(scan_fit, sizes, num_searches, cold, scanned);
+        if (memcmp(walked, scanned, num_searches * sizeof(block_t *)) != 0)
+            app_error("the walk and the scan found different blocks");
+        printf("%-8d ", n);
+        print_result(walk);
+        print_result(scan);
+        printf("\n");
+    }
+    if (miss_fd < 0) {
+        printf("(cache misses need perf events, see perf_event_paranoid)\n");
+    }
+
+    free(pool.sizes);
+    free(sizes);
+    free(walked);
+    free(scanned);
+    free(region);
+    free(flush_buf);
+    return 0;
+}
@@ -21,6 +21,7 @@
 #define MAXLINE 1024       /* max string size */
 #define MAX_REPL_SIZE 1024 /* max string size */
 #define HDRLINES 4         /* number of header lines in a trace file */
+#define BATCH_MAX 64       /* most requests in one batch call */
 #define LINENUM(i)                                            \
     (i + 5) /* cnvt trace request nums to linenums (origin 1) \
              */
@@ -82,6 +83,17 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util; /* space utilization for this trace (always 0 for libc) */
+    double heap_peak;  /* largest heap size in bytes during the util run */
+    double heap_final; /* heap size in bytes at the end of the util run */
+    double heap_avg;   /* heap size in bytes, averaged over every request */
+    long sbrks;        /* sbrk calls that grew the heap during the util run */
+    double copied;     /* payload bytes that moving reallocs had to copy */
+    long moves;        /* reallocs that returned a different address */
+    long slack;        /* reallocs that fit in the block's usable size */
+    int batch_valid;   /* did the batch calls process the trace correctly? */
+    double batch_secs; /* secs needed to run the trace with the batch calls */
+    int counted;            /* did mm_get_stats fill in counters? */
+    mm_stats_t counters;    /* the allocator's own counters for the util run */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -90,6 +102,10 @@ typedef struct {
  * Global variables
  *******************/
 int verbose = 0;         /* global flag for verbose output */
+static int sized = 0;    /* use the size-aware calls (set by -s) */
+static int batch = 0;    /* also time the batch calls (set by -b) */
+static int counters = 0; /* print the allocator's counters (set by -S) */
+static int zeroing = 0;  /* replay odd allocations as mm_calloc (set by -z) */
 static int errors = 0;   /* number of errs found when running student malloc */
 char msg[MAXLINE + 100]; /* for whenever we need to compose an error message */
 
@@ -120,14 +136,21 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+                           stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static int eval_mm_batch_valid(trace_t *trace, int tracenum,
+                               range_t **ranges);
+static void eval_mm_batch_speed(void *ptr);
 
 /* Various helper routines */
 static double compute_performance_index(int num_tracefiles, double secs,
                                         double ops, double util);
 static void printresults(int n, stats_t *stats);
 static void printpassed(int n, stats_t *stats);
+static void printbatch(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printgrowth(void);
 static void printresultsgradescope(int n, stats_t *stats);
 
 static void usage(void);
@@ -162,7 +185,7 @@ int main(int argc, char **argv) {
      * Read and interpret the command line arguments
      */
 
-    while ((c = getopt(argc, argv, "f:t:hvVgGalr")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgGalrsbSz")) != EOF) {
         switch (c) {
             case 'r': /* start repl */
                 driver();
@@ -193,6 +216,18 @@ int main(int argc, char **argv) {
             case 'l': /* Run libc malloc */
                 run_libc = 1;
                 break;
+            case 's': /* Free with mm_free_sized, realloc into the slack */
+                sized = 1;
+                break;
+            case 'b': /* Time mm_malloc_batch and mm_free_batch as well */
+                batch = 1;
+                break;
+            case 'S': /* Print the counters mm_get_stats keeps */
+                counters = 1;
+                break;
+            case 'z': /* Check mm_calloc zeroes the blocks it hands out */
+                zeroing = 1;
+                break;
             case 'v': /* verbose mode -v */
                 verbose = 1;
                 break;
@@ -275,12 +310,20 @@ int main(int argc, char **argv) {
         mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
         if (mm_stats[i].valid) {
             if (verbose > 1) printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+            mm_stats[i].util = eval_mm_util(trace, i, &ranges, &mm_stats[i]);
             speed_params.trace = trace;
             speed_params.ranges = ranges;
             if (verbose > 1) printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
         }
+        if (batch) {
+            mm_stats[i].batch_valid = eval_mm_batch_valid(trace, i, &ranges);
+            if (mm_stats[i].batch_valid) {
+                speed_params.trace = trace;
+                mm_stats[i].batch_secs =
+                    fsecs(eval_mm_batch_speed, &speed_params);
+            }
+        }
         free_trace(trace);
     }
 
@@ -288,8 +331,15 @@ int main(int argc, char **argv) {
     if (verbose) {
         printf("\nResults for mm malloc:\n");
         printresults(num_tracefiles, mm_stats);
+        printgrowth();
         printf("\n");
     }
+    if (batch) {
+        printbatch(num_tracefiles, mm_stats);
+    }
+    if (counters) {
+        printcounters(num_tracefiles, mm_stats);
+    }
 
     if (gradescope) {
         printresultsgradescope(num_tracefiles, mm_stats);
@@ -361,9 +411,11 @@ static int add_range(range_t **ranges, char *lo, int size, int tracenum,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within one of
+     * the mappings the allocator got for a large object */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_mapped(lo, hi)) {
         sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)", lo, hi,
                 mem_heap_lo(), mem_heap_hi());
         malloc_error(tracenum, opnum, msg);
@@ -541,13 +593,14 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
     int i, j;
     int index;
     int size;
+    long usable;
     int oldsize;
     char *newp;
     char *oldp;
     char *p;
 
     /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
+    mem_reset_heap();
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
@@ -564,8 +617,12 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
         switch (trace->ops[i].type) {
             case ALLOC: /* mm_malloc */
 
-                /* Call the student's malloc */
-                if ((p = mm_malloc(size)) == NULL && size) {
+                /* Call the student's malloc, or calloc for odd ids with -z */
+                if (zeroing && (index & 1))
+                    p = mm_calloc(1, size);
+                else
+                    p = mm_malloc(size);
+                if (p == NULL && size) {
                     malloc_error(tracenum, i, "mm_malloc failed.");
                     return 0;
                 } else if (!size) {
@@ -573,19 +630,38 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
                     break;
                 }
 
+                /* Every requested byte of a calloc'd block must be zero */
+                if (zeroing && (index & 1)) {
+                    for (j = 0; j < size; j++) {
+                        if (p[j] != 0) {
+                            malloc_error(tracenum, i,
+                                         "mm_calloc returned a block that is "
+                                         "not zeroed.");
+                            return 0;
+                        }
+                    }
+                }
+
                 /*
                  * Test the range of the new block for correctness and add it
                  * to the range list if OK. The block must be  be aligned
                  * properly, and must not overlap any currently allocated block.
+                 * The whole usable size is checked, since callers may use it.
                  */
-                if (add_range(ranges, p, size, tracenum, i) == 0) return 0;
+                usable = mm_usable_size(p);
+                if (usable < size) {
+                    malloc_error(tracenum, i,
+                                 "mm_usable_size is smaller than the request.");
+                    return 0;
+                }
+                if (add_range(ranges, p, usable, tracenum, i) == 0) return 0;
 
                 /* ADDED: cgw
                  * fill range with low byte of index.  This will be used later
                  * if we realloc the block and wish to make sure that the old
                  * data was copied to the new block
                  */
-                memset(p, index & 0xFF, size);
+                memset(p, index & 0xFF, usable);
 
                 /* Remember region */
                 trace->blocks[index] = p;
@@ -594,9 +670,11 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
 
             case REALLOC: /* mm_realloc */
 
-                /* Call the student's realloc */
+                /* Call the student's realloc, unless the block has the room */
                 oldp = trace->blocks[index];
-                if ((newp = mm_realloc(oldp, size)) == NULL && size) {
+                if (sized && size && size <= mm_usable_size(oldp)) {
+                    newp = oldp;
+                } else if ((newp = mm_realloc(oldp, size)) == NULL && size) {
                     malloc_error(tracenum, i, "mm_realloc failed.");
                     return 0;
                 } else if (!size) {
@@ -609,7 +687,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
                 remove_range(ranges, oldp);
 
                 /* Check new block for correctness and add it to range list */
-                if (add_range(ranges, newp, size, tracenum, i) == 0) return 0;
+                usable = mm_usable_size(newp);
+                if (usable < size) {
+                    malloc_error(tracenum, i,
+                                 "mm_usable_size is smaller than the request.");
+                    return 0;
+                }
+                if (add_range(ranges, newp, usable, tracenum, i) == 0) return 0;
 
                 /* ADDED: cgw
                  * Make sure that the new block contains the data from the old
@@ -626,7 +710,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
                         return 0;
                     }
                 }
-                memset(newp, index & 0xFF, size);
+                memset(newp, index & 0xFF, usable);
 
                 /* Remember region */
                 trace->blocks[index] = newp;
@@ -638,7 +722,11 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
                 /* Remove region from list and call student's free function */
                 p = trace->blocks[index];
                 remove_range(ranges, p);
-                mm_free(p);
+                if (sized) {
+                    mm_free_sized(p, trace->block_sizes[index]);
+                } else {
+                    mm_free(p);
+                }
                 break;
 
             default:
@@ -655,17 +743,22 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   high water mark of the heap in bytes (every region plus every
+ *   large-object mapping) while running the student's malloc package
+ *   on the trace. Unmapping a large object lowers the current heap
+ *   size but not its high water mark.
  *
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+                           stats_t *stats) {
     assert((int)tracenum || 1);
     assert((long)ranges || 1);
 
     int i;
+    double heap_sum = 0; /* sum of the heap size after every request */
+    double copied = 0;   /* payload bytes copied by reallocs that moved */
+    long moves = 0;      /* reallocs that moved their block */
+    long slack = 0;      /* reallocs that fit in the block's usable size */
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
@@ -674,7 +767,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
     char *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
+    mem_reset_heap();
     clear_ranges(ranges);
     if (mm_init() < 0) app_error("mm_init failed in eval_mm_util");
     for (i = 0; i < trace->num_ops; i++) {
@@ -718,13 +811,22 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
                 oldsize = trace->block_sizes[index];
 
                 oldp = trace->blocks[index];
-                if ((newp = mm_realloc(oldp, newsize)) == NULL && size) {
+                if (sized && newsize && newsize <= mm_usable_size(oldp)) {
+                    newp = oldp; /* the block already has the room */
+                    slack++;
+                } else if ((newp = mm_realloc(oldp, newsize)) == NULL && size) {
                     app_error("mm_realloc failed in eval_mm_util");
                 } else if (!size) {
                     // do not proceed further if the size is 0
                     break;
                 }
 
+                /* A block that moved had its payload copied */
+                if (newp != oldp) {
+                    copied += (newsize < oldsize) ? newsize : oldsize;
+                    moves++;
+                }
+
                 /* Still need to memset and check region integrity */
                 remove_range(ranges, oldp);
 
@@ -752,7 +854,11 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
                 p = trace->blocks[index];
                 remove_range(ranges, p);
 
-                mm_free(p);
+                if (sized) {
+                    mm_free_sized(p, size);
+                } else {
+                    mm_free(p);
+                }
 
                 /* Keep track of current total size
                  * of all allocated blocks */
@@ -763,9 +869,18 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
             default:
                 app_error("Nonexistent request type in eval_mm_util");
         }
+        heap_sum += mem_heapsize();
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    stats->heap_peak = mem_peak_heapsize();
+    stats->heap_final = mem_heapsize();
+    stats->heap_avg = trace->num_ops ? heap_sum / trace->num_ops : 0;
+    stats->sbrks = mem_sbrk_count();
+    stats->copied = copied;
+    stats->moves = moves;
+    stats->slack = slack;
+    stats->counted = mm_get_stats(&stats->counters) == 0;
+    return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 /*
@@ -793,22 +908,29 @@ static void eval_mm_speed(void *ptr) {
                     app_error("mm_malloc error in eval_mm_speed");
                 memset(p, index & 0xFF, size);
                 trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
                 break;
 
             case REALLOC: /* mm_realloc */
                 index = trace->ops[i].index;
                 newsize = trace->ops[i].size;
                 oldp = trace->blocks[index];
-                if ((newp = mm_realloc(oldp, newsize)) == NULL)
+                if (sized && newsize && newsize <= mm_usable_size(oldp))
+                    newp = oldp;
+                else if ((newp = mm_realloc(oldp, newsize)) == NULL)
                     app_error("mm_realloc error in eval_mm_speed");
                 memset(newp, index & 0xFF, size);
                 trace->blocks[index] = newp;
+                trace->block_sizes[index] = newsize;
                 break;
 
             case FREE: /* mm_free */
                 index = trace->ops[i].index;
                 block = trace->blocks[index];
-                mm_free(block);
+                if (sized)
+                    mm_free_sized(block, trace->block_sizes[index]);
+                else
+                    mm_free(block);
                 break;
 
             default:
@@ -817,6 +939,146 @@ static void eval_mm_speed(void *ptr) {
     }
 }
 
+/*
+ * batch_len - the number of requests starting at request i that one batch
+ *    call can make: a run of allocations of the same size, or a run of frees
+ */
+static int batch_len(trace_t *trace, int i) {
+    int n = 1;
+    traceop_t *op = &trace->ops[i];
+
+    if (op->type == REALLOC) return 1;
+    while (n < BATCH_MAX && i + n < trace->num_ops &&
+           trace->ops[i + n].type == op->type &&
+           (op->type == FREE || trace->ops[i + n].size == op->size))
+        n++;
+    return n;
+}
+
+/*
+ * eval_mm_batch_valid - Check the mm malloc package for correctness when
+ *    runs of requests go through mm_malloc_batch and mm_free_batch
+ */
+static int eval_mm_batch_valid(trace_t *trace, int tracenum,
+                               range_t **ranges) {
+    int i, j, n, index, size;
+    char *p, *newp;
+    void *ptrs[BATCH_MAX];
+
+    mem_reset_heap();
+    clear_ranges(ranges);
+    if (mm_init() < 0) {
+        malloc_error(tracenum, 0, "mm_init failed.");
+        return 0;
+    }
+
+    for (i = 0; i < trace->num_ops; i += n) {
+        n = batch_len(trace, i);
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+            case ALLOC: /* mm_malloc_batch */
+                if (size == 0) break;
+                if (mm_malloc_batch(size, n, ptrs) != n) {
+                    malloc_error(tracenum, i, "mm_malloc_batch failed.");
+                    return 0;
+                }
+                for (j = 0; j < n; j++) {
+                    index = trace->ops[i + j].index;
+                    p = ptrs[j];
+                    if (add_range(ranges, p, size, tracenum, i + j) == 0)
+                        return 0;
+                    memset(p, index & 0xFF, size);
+                    trace->blocks[index] = p;
+                    trace->block_sizes[index] = size;
+                }
+                break;
+
+            case REALLOC: /* mm_realloc */
+                index = trace->ops[i].index;
+                p = trace->blocks[index];
+                if ((newp = mm_realloc(p, size)) == NULL && size) {
+                    malloc_error(tracenum, i, "mm_realloc failed.");
+                    return 0;
+                } else if (!size) {
+                    break;
+                }
+                remove_range(ranges, p);
+                if (add_range(ranges, newp, size, tracenum, i) == 0) return 0;
+                for (j = 0; j < size && j < trace->block_sizes[index]; j++) {
+                    if (newp[j] != (index & 0xFF)) {
+                        malloc_error(tracenum, i,
+                                     "mm_realloc did not preserve the "
+                                     "data from old block");
+                        return 0;
+                    }
+                }
+                memset(newp, index & 0xFF, size);
+                trace->blocks[index] = newp;
+                trace->block_sizes[index] = size;
+                break;
+
+            case FREE: /* mm_free_batch */
+                for (j = 0; j < n; j++) {
+                    ptrs[j] = trace->blocks[trace->ops[i + j].index];
+                    remove_range(ranges, ptrs[j]);
+                }
+                mm_free_batch(ptrs, n);
+                break;
+
+            default:
+                app_error("Nonexistent request type in eval_mm_batch_valid");
+        }
+    }
+    return 1;
+}
+
+/*
+ * eval_mm_batch_speed - the batch counterpart of eval_mm_speed, timed by
+ *    fcyc()
+ */
+static void eval_mm_batch_speed(void *ptr) {
+    int i, j, n, index, size;
+    char *newp;
+    void *ptrs[BATCH_MAX];
+    trace_t *trace = ((speed_t *)ptr)->trace;
+
+    mem_reset_brk();
+    if (mm_init() < 0) app_error("mm_init failed in eval_mm_batch_speed");
+
+    for (i = 0; i < trace->num_ops; i += n) {
+        n = batch_len(trace, i);
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+            case ALLOC: /* mm_malloc_batch */
+                if (mm_malloc_batch(size, n, ptrs) != n)
+                    app_error("mm_malloc_batch error in eval_mm_batch_speed");
+                for (j = 0; j < n; j++) {
+                    index = trace->ops[i + j].index;
+                    memset(ptrs[j], index & 0xFF, size);
+                    trace->blocks[index] = ptrs[j];
+                }
+                break;
+
+            case REALLOC: /* mm_realloc */
+                index = trace->ops[i].index;
+                if ((newp = mm_realloc(trace->blocks[index], size)) == NULL)
+                    app_error("mm_realloc error in eval_mm_batch_speed");
+                memset(newp, index & 0xFF, size);
+                trace->blocks[index] = newp;
+                break;
+
+            case FREE: /* mm_free_batch */
+                for (j = 0; j < n; j++)
+                    ptrs[j] = trace->blocks[trace->ops[i + j].index];
+                mm_free_batch(ptrs, n);
+                break;
+
+            default:
+                app_error("Nonexistent request type in eval_mm_batch_speed");
+        }
+    }
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -969,6 +1231,107 @@ static void printresults(int n, stats_t *stats) {
     } else {
         printf("%12s%30s%6s%7s%11s\n", "Total        ", "-", "-", "-", "-");
     }
+
+    /* Print how the heap size moved over each trace */
+    printf("\n%6s %4s                %13s%10s%10s%8s%10s%7s%7s\n", "trace#",
+           " name", "peak KB", "final KB", "avg KB", "sbrks", "copy KB",
+           "moves", "slack");
+    printf(
+        "----------------------------------------------------------------------"
+        "-------------------------"
+        "\n");
+    for (i = 0; i < n; i++) {
+        if (stats[i].valid) {
+            printf(" %-2d     %-19s   %10.1f%10.1f%10.1f%8ld%10.1f%7ld%7ld\n",
+                   i, stats[i].trace_name, stats[i].heap_peak / 1024,
+                   stats[i].heap_final / 1024, stats[i].heap_avg / 1024,
+                   stats[i].sbrks, stats[i].copied / 1024, stats[i].moves,
+                   stats[i].slack);
+        }
+    }
+}
+
+/*
+ * printbatch - compare the cost per request of the single calls with that
+ *    of the batch calls
+ */
+static void printbatch(int n, stats_t *stats) {
+    int i;
+
+    printf("%6s %4s                %12s%12s%10s\n", "trace#", " name",
+           "single ns", "batch ns", "speedup");
+    printf(
+        "----------------------------------------------------------------------"
+        "\n");
+    for (i = 0; i < n; i++) {
+        if (stats[i].valid && stats[i].batch_valid) {
+            printf(" %-2d     %-19s   %10.1f%12.1f%9.2fx\n", i,
+                   stats[i].trace_name, stats[i].secs * 1e9 / stats[i].ops,
+                   stats[i].batch_secs * 1e9 / stats[i].ops,
+                   stats[i].secs / stats[i].batch_secs);
+        } else {
+            printf(" %-2d     %-19s   %10s%12s%10s\n", i, stats[i].trace_name,
+                   "-", "-", "-");
+        }
+    }
+    printf("\n");
+}
+
+/*
+ * printgrowth - Print the heap growth policy mm.c was built with, under the
+ *     heap table its parameters shape
+ */
+static void printgrowth(void) {
+    mm_growth_t g = mm_growth();
+
+    if (g.adaptive) {
+        printf("heap growth: adaptive, %ld to %ld bytes (doubled when growing "
+               "within %ld mallocs,\n             halved after %ld without); ",
+               g.min, g.max, g.burst, g.quiet);
+    } else {
+        printf("heap growth: fixed, max(%ld bytes, request); ", g.min);
+    }
+    printf("top trimmed at %ld bytes\n", g.trim);
+}
+
+/*
+ * printcounters - Print the allocator's own counters for each trace's util
+ *     run: how many free blocks each malloc probed, and what the heap did
+ */
+static void printcounters(int n, stats_t *stats) {
+    int i, j;
+    static char *buckets[MM_PROBE_BUCKETS] = {
+        "1", "2", "3-4", "5-8", "9-16", "17-32", "33-64", "65+"};
+
+    if (n > 0 && !stats[0].counted) {
+        printf("mm.c was built without MM_STATS; try mdriver-stats\n\n");
+        return;
+    }
+    printf("mallocs by free blocks probed\n");
+    printf("%6s %4s                ", "trace#", " name");
+    for (j = 0; j < MM_PROBE_BUCKETS; j++) printf("%8s", buckets[j]);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+        printf(" %-2d     %-19s   ", i, stats[i].trace_name);
+        for (j = 0; j < MM_PROBE_BUCKETS; j++)
+            printf("%8ld", stats[i].counters.probe_hist[j]);
+        printf("\n");
+    }
+    printf("\n%6s %4s                %7s%7s%7s%7s%6s%9s%8s%7s%9s\n", "trace#",
+           " name", "splits", "c-prev", "c-next", "c-both", "sbrks",
+           "sbrk KB", "re-kept", "re-mv", "moved KB");
+    printf(
+        "--------------------------------------------------------------------"
+        "--------------------------\n");
+    for (i = 0; i < n; i++) {
+        mm_stats_t *c = &stats[i].counters;
+        printf(" %-2d     %-19s   %7ld%7ld%7ld%7ld%6ld%9.1f%8ld%7ld%9.1f\n", i,
+               stats[i].trace_name, c->splits, c->coalesce_prev,
+               c->coalesce_next, c->coalesce_both, c->sbrks,
+               c->sbrk_bytes / 1024.0, c->realloc_in_place, c->realloc_moved,
+               c->moved_bytes / 1024.0);
+    }
+    printf("\n");
 }
 
 static void printresultsgradescope(int n, stats_t *stats) {
@@ -1082,14 +1445,27 @@ void malloc_error(int tracenum, int opnum, char *msg) {
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-    fprintf(stderr, "Usage: mdriver [-hvValr] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValrsbSz] [-f <file>] [-t <dir>]\n");
     fprintf(stderr, "Options\n");
+    fprintf(stderr,
+            "\t-b         Also replay runs of same-size allocations and of "
+            "frees\n\t           with mm_malloc_batch and mm_free_batch.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-r         Open the malloc REPL.\n");
+    fprintf(stderr,
+            "\t-s         Free with mm_free_sized, and skip reallocs that fit "
+            "in\n\t           mm_usable_size.\n");
+    fprintf(stderr,
+            "\t-S         Print the allocator's counters for each trace "
+            "(needs\n\t           mm.c built with MM_STATS, as in "
+            "mdriver-stats).\n");
     fprintf(stderr, "\t-G         Generates a ./gradescope-report.txt file.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr,
+            "\t-z         Allocate odd block ids with mm_calloc and check "
+            "they\n\t           come back zeroed.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
     fprintf(stderr, "\t-p         activates repl\n");
@@ -1195,7 +1571,8 @@ void mm_print_heap_repl(repl_block_t blocks[], int repl_size) {
                 (void *)block_blink(b));
         }
         long s1 = block_size(b);
-        long s2 = block_end_size(b);
+        // allocated blocks have no end tag, so only free blocks are checked
+        long s2 = block_allocated(b) ? s1 : block_end_size(b);
         if (s1 != s2) {
             printf("block%s at %p had differing size tags: %d and %d\n\n",
                    indexstr, (void *)b, (int)s1, (int)s2);
@@ -1271,7 +1648,7 @@ void reset_cmd(const char *msg) {
     if (msg == NULL) {
         printf("msg is null\n");
     }
-    mem_reset_brk();
+    mem_reset_heap();
     clear_ranges(&(repl_state->ranges));
 
     /* Call the mm package's init function */
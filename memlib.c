@@ -3,8 +3,10 @@
  *            allows us to interleave calls from the student's malloc package
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE /* for mremap */
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,65 +17,298 @@
 #include "memlib.h"
 
 /* private variables */
-static char *mem_start_brk; /* points to first byte of heap */
-static char *mem_brk;       /* points to last byte of heap */
-static char *mem_max_addr;  /* largest legal heap address */
+/*
+ * Each region is an independent sbrk-style heap. mem_init maps them all up
+ * front, so a region's bounds never change while threads look them up.
+ */
+static char *mem_start_brk[MEM_MAX_REGIONS]; /* first byte of each heap */
+static char *mem_brk[MEM_MAX_REGIONS];       /* last byte of each heap */
+static char *mem_max_addr[MEM_MAX_REGIONS];  /* largest legal heap address */
+static char *mem_dirty[MEM_MAX_REGIONS];     /* highest brk since zeroing */
+static char *mem_touched[MEM_MAX_REGIONS];   /* highest brk since scrubbing */
+
+/*
+ * Large objects can also get their own page-aligned mapping, outside every
+ * region. The live mappings are kept in a list so the driver can check that
+ * payloads lie in memory the allocator owns.
+ */
+typedef struct mapping {
+    char *lo;
+    long size;
+    struct mapping *next;
+} mapping_t;
+
+static mapping_t *mem_mappings; /* live mappings */
+static long mem_grow_count;     /* sbrk calls that grew a heap since reset */
+/* bytes in every region's heap and every live mapping, and the most there
+ * have been since reset. Threads update them atomically, without a lock. */
+static long mem_total_size;
+static long mem_peak_size;
+static pthread_mutex_t mem_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * mem_note_size - add incr bytes to the total heap size and update its
+ *    high-water mark
+ */
+static void mem_note_size(long incr) {
+    long size = __atomic_add_fetch(&mem_total_size, incr, __ATOMIC_RELAXED);
+    long peak = __atomic_load_n(&mem_peak_size, __ATOMIC_RELAXED);
+    while (size > peak &&
+           !__atomic_compare_exchange_n(&mem_peak_size, &peak, size, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/*
+ * mem_region_alloc - allocate the storage that models one region's VM. Like
+ *    fresh pages from the kernel, the storage starts out zero-filled.
+ */
+static int mem_region_alloc(int region) {
+    char *lo = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (lo == MAP_FAILED) {
+        return -1;
+    }
+    mem_start_brk[region] = lo;
+    mem_max_addr[region] = mem_start_brk[region] + MAX_HEAP;
+    mem_brk[region] = mem_start_brk[region]; /* heap is empty initially */
+    mem_dirty[region] = mem_start_brk[region];
+    mem_touched[region] = mem_start_brk[region];
+    return 0;
+}
 
 /*
  * mem_init - initialize the memory system model
  */
 void mem_init(void) {
     /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-        fprintf(stderr, "mem_init_vm: malloc error\n");
-        exit(1);
+    for (int i = 0; i < MEM_MAX_REGIONS; i++) {
+        if (mem_region_alloc(i) < 0) {
+            fprintf(stderr, "mem_init_vm: malloc error\n");
+            exit(1);
+        }
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP; /* max legal heap address */
-    mem_brk = mem_start_brk;                 /* heap is empty initially */
 }
 
 /*
  * mem_deinit - free the storage used by the memory system model
  */
-void mem_deinit(void) { free(mem_start_brk); }
+void mem_deinit(void) {
+    for (int i = 0; i < MEM_MAX_REGIONS; i++) {
+        if (mem_start_brk[i] != NULL) munmap(mem_start_brk[i], MAX_HEAP);
+        mem_start_brk[i] = NULL;
+    }
+}
+
+/*
+ * mem_reset_brk - reset the simulated brk pointers to make empty heaps, and
+ *    drop every mapping. Only the pointers move, so this is cheap enough for
+ *    the timed runs, but the heaps are not rezeroed: memory handed out again
+ *    may hold bytes from before the reset. Use mem_reset_heap when the
+ *    contents matter.
+ */
+void mem_reset_brk() {
+    for (int i = 0; i < MEM_MAX_REGIONS; i++) {
+        mem_brk[i] = mem_start_brk[i];
+        mem_dirty[i] = mem_start_brk[i];
+    }
+    pthread_mutex_lock(&mem_map_lock);
+    while (mem_mappings != NULL) {
+        mapping_t *m = mem_mappings;
+        mem_mappings = m->next;
+        munmap(m->lo, m->size);
+        free(m);
+    }
+    mem_total_size = 0;
+    mem_peak_size = 0;
+    mem_grow_count = 0;
+    pthread_mutex_unlock(&mem_map_lock);
+}
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_heap - like mem_reset_brk, but also hands the used part of each
+ *    region back to the kernel, so fresh heap memory reads as zero again
  */
-void mem_reset_brk() { mem_brk = mem_start_brk; }
+void mem_reset_heap() {
+    for (int i = 0; i < MEM_MAX_REGIONS; i++) {
+        if (mem_touched[i] > mem_start_brk[i]) {
+            madvise(mem_start_brk[i], mem_touched[i] - mem_start_brk[i],
+                    MADV_DONTNEED);
+        }
+        mem_touched[i] = mem_start_brk[i];
+    }
+    mem_reset_brk();
+}
 
 /*
- * mem_sbrk - simple model of the sbrk function. Extends the heap
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ * mem_region_sbrk - simple model of the sbrk function for one region.
+ *    Extends the region's heap by incr bytes and returns the start address
+ *    of the new area. A negative incr shrinks the heap by -incr bytes, giving
+ *    back the top of the heap; it returns the old brk, as sbrk does. Calls for
+ *    different regions may run concurrently; calls for the same region
+ *    must not. The new area is zero-filled, even if it was handed out
+ *    and given back before, just as the kernel zeroes fresh pages (unless
+ *    mem_reset_brk left stale bytes there).
  */
-void *mem_sbrk(int incr) {
-    char *old_brk = mem_brk;
+void *mem_region_sbrk(int region, int incr) {
+    assert(region >= 0 && region < MEM_MAX_REGIONS);
+    assert(mem_start_brk[region] != NULL);
 
-    if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    char *old_brk = mem_brk[region];
+
+    if ((mem_brk[region] + incr < mem_start_brk[region]) ||
+        ((mem_brk[region] + incr) > mem_max_addr[region])) {
         errno = ENOMEM;
         fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
         return (void *)-1;
     }
-    mem_brk += incr;
+    mem_brk[region] += incr;
+    if (old_brk < mem_dirty[region]) { /* rezero memory given back earlier */
+        char *end = mem_brk[region];
+        if (end > mem_dirty[region]) end = mem_dirty[region];
+        if (end > old_brk) memset(old_brk, 0, end - old_brk);
+    }
+    if (mem_brk[region] > mem_dirty[region]) {
+        mem_dirty[region] = mem_brk[region];
+    }
+    if (mem_brk[region] > mem_touched[region]) {
+        mem_touched[region] = mem_brk[region];
+    }
+    if (incr > 0) __atomic_fetch_add(&mem_grow_count, 1, __ATOMIC_RELAXED);
+    mem_note_size(incr);
     return (void *)old_brk;
 }
 
 /*
- * mem_heap_lo - return address of the first heap byte
+ * mem_map - gives the caller a fresh mapping of at least size bytes,
+ *    starting on a page boundary. Returns NULL if the mapping failed.
  */
-void *mem_heap_lo() { return (void *)mem_start_brk; }
+void *mem_map(long size) {
+    mapping_t *m = malloc(sizeof(mapping_t));
+    if (m == NULL) return NULL;
+    m->size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    m->lo = mmap(NULL, m->size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m->lo == MAP_FAILED) {
+        free(m);
+        return NULL;
+    }
+    pthread_mutex_lock(&mem_map_lock);
+    m->next = mem_mappings;
+    mem_mappings = m;
+    mem_note_size(m->size);
+    pthread_mutex_unlock(&mem_map_lock);
+    return m->lo;
+}
 
 /*
- * mem_heap_hi - return address of last heap byte
+ * mem_find_mapping - returns the link that points at the mapping starting
+ *    at lo. The caller must hold mem_map_lock.
  */
-void *mem_heap_hi() { return (void *)(mem_brk - 1); }
+static mapping_t **mem_find_mapping(void *lo) {
+    mapping_t **link = &mem_mappings;
+    while (*link != NULL && (*link)->lo != (char *)lo) link = &(*link)->next;
+    assert(*link != NULL);
+    return link;
+}
+
+/*
+ * mem_remap - resizes the mapping starting at lo to at least size bytes,
+ *    moving it if it cannot grow in place. Returns the mapping's new start,
+ *    or NULL (leaving the mapping alone) if it could not be resized.
+ */
+void *mem_remap(void *lo, long size) {
+    size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    pthread_mutex_lock(&mem_map_lock);
+    mapping_t *m = *mem_find_mapping(lo);
+    char *new_lo = mremap(m->lo, m->size, size, MREMAP_MAYMOVE);
+    if (new_lo == MAP_FAILED) {
+        pthread_mutex_unlock(&mem_map_lock);
+        return NULL;
+    }
+    mem_note_size(size - m->size);
+    m->lo = new_lo;
+    m->size = size;
+    pthread_mutex_unlock(&mem_map_lock);
+    return new_lo;
+}
+
+/*
+ * mem_unmap - gives back the mapping starting at lo
+ */
+void mem_unmap(void *lo) {
+    pthread_mutex_lock(&mem_map_lock);
+    mapping_t **link = mem_find_mapping(lo);
+    mapping_t *m = *link;
+    *link = m->next;
+    mem_note_size(-m->size);
+    pthread_mutex_unlock(&mem_map_lock);
+    munmap(m->lo, m->size);
+    free(m);
+}
+
+/*
+ * mem_mapped - returns 1 if lo through hi lie in a single live mapping
+ */
+int mem_mapped(void *lo, void *hi) {
+    int found = 0;
+    pthread_mutex_lock(&mem_map_lock);
+    for (mapping_t *m = mem_mappings; m != NULL; m = m->next) {
+        if ((char *)lo >= m->lo && (char *)hi < m->lo + m->size) {
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mem_map_lock);
+    return found;
+}
+
+/*
+ * mem_sbrk - extends (or, for a negative incr, shrinks) the main heap
+ *    (region 0) by incr bytes
+ */
+void *mem_sbrk(int incr) { return mem_region_sbrk(0, incr); }
+
+/*
+ * mem_region_lo - return address of the first byte of a region's heap
+ */
+void *mem_region_lo(int region) { return (void *)mem_start_brk[region]; }
+
+/*
+ * mem_region_hi - return address of the last byte of a region's heap
+ */
+void *mem_region_hi(int region) { return (void *)(mem_brk[region] - 1); }
+
+/*
+ * mem_heap_lo - return address of the first byte of the main heap
+ */
+void *mem_heap_lo() { return mem_region_lo(0); }
+
+/*
+ * mem_heap_hi - return address of last byte of the main heap
+ */
+void *mem_heap_hi() { return mem_region_hi(0); }
+
+/*
+ * mem_heapsize() - returns the heap size in bytes, over every region and
+ *    mapping
+ */
+long mem_heapsize() {
+    return __atomic_load_n(&mem_total_size, __ATOMIC_RELAXED);
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size since the last reset
+ */
+long mem_peak_heapsize() {
+    return __atomic_load_n(&mem_peak_size, __ATOMIC_RELAXED);
+}
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_sbrk_count() - returns how many sbrk calls grew a heap since the last
+ *    reset
  */
-long mem_heapsize() { return (long)(mem_brk - mem_start_brk); }
+long mem_sbrk_count() { return mem_grow_count; }
 
 /*
  * mem_pagesize() - returns the page size of the system
@@ -3,13 +3,26 @@
 
 #include <unistd.h>
 
+/* number of independent sbrk-style heaps; region 0 is the main heap */
+#define MEM_MAX_REGIONS 8
+
 void mem_init(void);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+void *mem_region_sbrk(int region, int incr);
+void *mem_region_lo(int region);
+void *mem_region_hi(int region);
+void *mem_map(long size);
+void *mem_remap(void *lo, long size);
+void mem_unmap(void *lo);
+int mem_mapped(void *lo, void *hi);
 void mem_reset_brk(void);
+void mem_reset_heap(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 long mem_heapsize(void);
+long mem_peak_heapsize(void);
+long mem_sbrk_count(void);
 long mem_pagesize(void);
 
 #endif
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,95 +18,1675 @@
  * Section 4.2 (Support Routines) of the handout has information about
  * the functions in mminline.h and memlib.h
  */
+#include "./config.h"
 #include "./memlib.h"
 #include "./mm.h"
 #include "./mminline.h"
 
-block_t *prologue;
-block_t *epilogue;
+// Bumped by mm_init so that arenas and per-thread caches set up for an older
+// heap are rebuilt or dropped instead of used.
+static unsigned long heap_generation;
+
+// When set to 1, mm_malloc only ever looks at the head of a single free list
+// (found through the size-class bitmaps), so every search takes constant time
+// at some cost in utilization. Build with -D BOUNDED_LATENCY=1 to enable it.
+#ifndef BOUNDED_LATENCY
+#define BOUNDED_LATENCY 0
+#endif
+
+// With PLACEMENT set to FIT_GOOD (see mminline.h), a search of a size class
+// stops after looking at this many blocks that fit
+#define GOOD_FIT_PROBES 4
+
+// A search of a size class gives up after probing FIT_BUDGET blocks (0 means
+// no limit) and takes the best fit it has seen, or, if there is none, the
+// head of a larger class or fresh memory from a heap extension. A fit that
+// wastes at most FIT_SLACK percent of the request ends the search early
+// under the policies that would otherwise keep looking. Build with
+// -D FIT_BUDGET=<n> and -D FIT_SLACK=<percent> to change them.
+#ifndef FIT_BUDGET
+#define FIT_BUDGET 0
+#endif
+#ifndef FIT_SLACK
+#define FIT_SLACK 0
+#endif
+
+// Requests of at least MMAP_THRESHOLD bytes get a page-aligned mapping of
+// their own from mem_map instead of a block in an arena, and the mapping is
+// given back as soon as they are freed. Build with -D MMAP_THRESHOLD=<bytes>
+// to change it.
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (128 * 1024)
+#endif
+
+// Once the free block at the top of an arena reaches TRIM_THRESHOLD bytes,
+// it is given back to memlib and the epilogue moves down over it. Build with
+// -D TRIM_THRESHOLD=<bytes> to change it.
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (64 * 1024)
+#endif
+
+// When set to 1, each arena sizes its heap extensions from how often it has
+// had to grow lately: growing again within GROW_BURST mallocs doubles the
+// chunk (up to GROW_MAX), going GROW_QUIET mallocs without growing halves it,
+// and so does a free that leaves at least a chunk unused at the top of the
+// heap. When set to 0, the heap always grows by max(GROW_MIN, request).
+#ifndef ADAPTIVE_GROWTH
+#define ADAPTIVE_GROWTH 1
+#endif
+#define GROW_MIN 512
+#define GROW_MAX (16 * 1024)
+#define GROW_BURST 32
+#define GROW_QUIET 1024
+
+// When set to 1, freed blocks of up to QUICK_MAX_SIZE bytes are not coalesced
+// right away. They stay allocated, as far as the heap can tell, on an
+// exact-size LIFO quick list of their arena, linked through their first
+// payload word, so that the next malloc of the same size takes one back
+// without splitting anything. The quick lists are consolidated (their blocks
+// freed and coalesced for real) when a malloc finds no fit anywhere else, or
+// once they hold more than QUICK_MAX_BYTES. Build with -D QUICK_LISTS=0 to
+// coalesce every free eagerly.
+#ifndef QUICK_LISTS
+#define QUICK_LISTS 1
+#endif
+#define QUICK_MAX_SIZE 512
+#define QUICK_BINS (QUICK_MAX_SIZE / ALIGNMENT + 1)
+#define QUICK_MAX_BYTES (16 * 1024)
+
+// When set to 1, a thread that frees a block owned by another arena pushes it
+// onto that arena's lock-free remote queue, and the owner frees it on its next
+// malloc. When set to 0, the block is freed right away under the owner's lock
+// instead. Build with -D REMOTE_QUEUE=0 to compare the two (mtbench -p).
+#ifndef REMOTE_QUEUE
+#define REMOTE_QUEUE 1
+#endif
+
+// When set to 1, every arena counts what its searches, splits, merges, heap
+// extensions and reallocs do, for mm_get_stats. When set to 0, the counting
+// compiles away. Build with -D MM_STATS=1 to enable it.
+#ifndef MM_STATS
+#define MM_STATS 0
+#endif
+#if MM_STATS
+#define STAT(counter, n) (arena->stats.counter += (n))
+#define STAT_PROBES(n) (arena->probes += (n))
+#else
+#define STAT(counter, n) ((void)0)
+#define STAT_PROBES(n) ((void)0)
+#endif
+// a free block looked at by a search
+#define STAT_PROBE() STAT_PROBES(1)
+// a realloc that had to copy its payload
+#define STAT_MOVE(bytes)                                 \
+    (STAT(realloc_in_place, -1), STAT(realloc_moved, 1), \
+     STAT(moved_bytes, (bytes)))
+
+// Each arena remembers the last few blocks that mm_realloc grew. Once a block
+// has grown GROWTH_STREAK times in a row it counts as growing: when it grows
+// at the top of the heap, the heap grows by an extra 1/GROWTH_HEADROOM of
+// the block, and when it has to move, it moves to the top of the heap, where
+// it can keep growing in place.
+#define GROWTH_SLOTS 4
+#define GROWTH_STREAK 2
+#define GROWTH_HEADROOM 4
+
+// Requests of at most SLAB_MAX_SIZE bytes are served from runs instead of
+// blocks: RUN_SIZE-aligned pages of equal-size slots, with no tags on the
+// slots themselves. Slot sizes are multiples of SLAB_CLASS_SIZE.
+#define RUN_SIZE 4096
+#define SLAB_CLASS_SIZE 16
+#define NUM_SLAB_CLASSES 4
+#define SLAB_MAX_SIZE (NUM_SLAB_CLASSES * SLAB_CLASS_SIZE)
+// words in a run's free-slot bitmap, enough for the smallest slot size
+#define RUN_MAP_WORDS (RUN_SIZE / SLAB_CLASS_SIZE / (8 * (int)sizeof(long)))
+
+// A run lives in the payload of an ordinary allocated block, placed so that
+// the payload starts on a RUN_SIZE boundary. The run header is at the start
+// of that page, so a slot's run is found by masking the slot's address.
+typedef struct run {
+    long slot_size;
+    int num_slots;
+    int num_free;
+    struct run *next;  // next partially free run with the same slot size
+    struct run *prev;  // previous partially free run with the same slot size
+    unsigned long free_map[RUN_MAP_WORDS];  // bit i is set if slot i is free
+    long slots[];
+} run_t;
+
+// The heap is split into NUM_ARENAS arenas, each its own heap in its own
+// memlib region with its own lock, so threads working in different arenas
+// never wait on each other. Threads are spread over the arenas round-robin;
+// a block always goes back to the arena whose region it lies in.
+#define NUM_ARENAS MEM_MAX_REGIONS
+
+typedef struct growth {
+    void *ptr;   // payload of a block mm_realloc grew last time it saw it
+    int streak;  // how many times in a row it has grown
+} growth_t;
+
+typedef struct arena {
+    pthread_mutex_t lock;      // held by every call working in this arena
+    unsigned long generation;  // heap_generation when the arena was set up
+    int region;                // the memlib region the arena's heap lives in
+    free_index_t index;
+    block_t *prologue;
+    block_t *epilogue;
+    // runs with at least one free slot, one NULL-terminated list per size
+    run_t *partial_runs[NUM_SLAB_CLASSES];
+    // run_pages[i] is 1 if the i-th RUN_SIZE page of the arena is a run
+    unsigned char run_pages[MAX_HEAP / RUN_SIZE + 2];
+    long grow_chunk;          // bytes the heap grows by at a time
+    long mallocs_since_grow;  // mallocs that reached the heap since it grew
+    growth_t growth[GROWTH_SLOTS];  // blocks that have been growing
+    int growth_victim;              // the slot the next new block replaces
+    // quick[i] is the quick list of blocks of i * ALIGNMENT bytes
+    void *quick[QUICK_BINS];
+    long quick_bytes;  // bytes of all the blocks on the quick lists
+#if MM_STATS
+    mm_stats_t stats;
+    long probes;  // free blocks the current search has probed
+#endif
+    // blocks and slots freed by threads whose home is another arena, linked
+    // through their first payload word. Pushed without the lock, drained
+    // with it.
+    void *remote_frees;
+} arena_t;
+
+static arena_t arenas[NUM_ARENAS];
+static pthread_once_t arenas_once = PTHREAD_ONCE_INIT;
+// hands out arenas to threads round-robin
+static unsigned int next_arena;
+// the arena the calling thread has locked and is working in
+static __thread arena_t *arena;
+// the arena the calling thread's mallocs go to
+static __thread arena_t *home_arena;
 
 // rounds up to the nearest multiple of WORD_SIZE
 static inline long align(long size) {
     return (((size) + (WORD_SIZE - 1)) & ~(WORD_SIZE - 1));
 }
 
-/*
- *                             _       _ _
- *     _ __ ___  _ __ ___     (_)_ __ (_) |_
- *    | '_ ` _ \| '_ ` _ \    | | '_ \| | __|
- *    | | | | | | | | | | |   | | | | | | |_
- *    |_| |_| |_|_| |_| |_|___|_|_| |_|_|\__|
- *                       |_____|
- *
- * initializes the dynamic storage allocator (allocate initial heap space)
- * arguments: none
- * returns: 0, if successful
- *         -1, if an error occurs
- */
-int mm_init(void) {
-    flist_first = NULL;
+/* heap_init: sets up an empty heap with just a prologue and an epilogue in
+the current arena
+arguments: none
+returns: 0, if successful
+         -1, if an error occurs
+NOTE: the caller must hold the arena's lock
+*/
+static int heap_init(void) {
+    memset(&arena->index, 0, sizeof(arena->index));  // empties every class
+    for (int i = 0; i < NUM_SLAB_CLASSES; i++) {
+        arena->partial_runs[i] = NULL;
+    }
+    memset(arena->run_pages, 0, sizeof(arena->run_pages));
+    __atomic_store_n(&arena->remote_frees, NULL, __ATOMIC_RELAXED);
+    arena->grow_chunk = GROW_MIN;
+    arena->mallocs_since_grow = 0;
+    memset(arena->growth, 0, sizeof(arena->growth));
+    memset(arena->quick, 0, sizeof(arena->quick));
+    arena->quick_bytes = 0;
+#if MM_STATS
+    memset(&arena->stats, 0, sizeof(arena->stats));
+#endif
+
+    void *holder = mem_region_sbrk(
+        arena->region, TAGS_SIZE);  // allocated space for the prologue
+
+    if (holder == (void *)-1) {  // error checking mem_sbrk
+        return -1;
+    } else {  // setting size, allocated, and pointer for prologue
+        arena->prologue = holder;
+        arena->index.base = holder;  // list links are offsets from here
+        block_set_size_and_allocated(arena->prologue, TAGS_SIZE, 1);
+        block_set_prev_allocated(arena->prologue, 1);
+    }
+
+    void *holder2 = mem_region_sbrk(
+        arena->region, TAGS_SIZE);  // allocated space for the epilogue
+
+    if (holder2 == (void *)-1) {  // error checking mem_sbrk
+        return -1;
+    } else {  // setting size, allocated, and pointer for epilogue
+        arena->epilogue = holder2;
+        block_set_size_and_allocated(arena->epilogue, TAGS_SIZE, 1);
+        block_set_prev_allocated(arena->epilogue, 1);
+    }
+    return 0;
+}
+
+/* arenas_setup: initializes the lock of every arena
+arguments: none
+returns: nothing
+*/
+static void arenas_setup(void) {
+    for (int i = 0; i < NUM_ARENAS; i++) {
+        pthread_mutex_init(&arenas[i].lock, NULL);
+        arenas[i].region = i;
+    }
+}
+
+/* arena_lock: locks an arena and makes it the current arena, setting up its
+heap first if mm_init has been called since it was last used
+arguments: a: the arena to lock
+returns: 0, if successful
+         -1, if the arena's heap could not be set up (a is left unlocked)
+*/
+static int arena_lock(arena_t *a) {
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    findex = &a->index;
+    if (a->generation != heap_generation) {  // heap is from an older mm_init
+        if (heap_init() < 0) {
+            pthread_mutex_unlock(&a->lock);
+            return -1;
+        }
+        a->generation = heap_generation;
+    }
+    return 0;
+}
+
+/* arena_unlock: unlocks an arena locked by arena_lock
+arguments: a: the arena to unlock
+returns: nothing
+*/
+static void arena_unlock(arena_t *a) { pthread_mutex_unlock(&a->lock); }
+
+/* arena_of: finds the arena a block or slot belongs to
+arguments: ptr: a pointer returned by mm_malloc or mm_realloc
+returns: the arena whose region contains ptr, or NULL if ptr is a large
+         object with its own mapping
+NOTE: this tests against each region's fixed bounds rather than its brk,
+which the owning thread may be moving
+*/
+static arena_t *arena_of(void *ptr) {
+    for (int i = 0; i < NUM_ARENAS; i++) {
+        char *lo = mem_region_lo(i);
+        if ((char *)ptr >= lo && (char *)ptr < lo + MAX_HEAP) {
+            return &arenas[i];
+        }
+    }
+    return NULL;
+}
+
+/* thread_arena: finds the arena the calling thread allocates from, handing
+one out round-robin on the thread's first call
+arguments: none
+returns: the calling thread's arena
+*/
+static arena_t *thread_arena(void) {
+    if (home_arena == NULL) {
+        unsigned int i = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+        home_arena = &arenas[i % NUM_ARENAS];
+    }
+    return home_arena;
+}
+
+/* map_size: finds how big a mapping a large object needs
+arguments: size: the requested payload size
+returns: the payload size plus a header, rounded up to a whole page
+*/
+static long map_size(long size) {
+    long page = mem_pagesize();
+    return (size + ALLOC_TAGS_SIZE + page - 1) & ~(page - 1);
+}
+
+/* map_alloc: gives a large object a mapping of its own
+arguments: size: the requested payload size
+returns: a pointer to the payload, or NULL if the mapping failed
+*/
+static void *map_alloc(long size) {
+    if (map_size(size) > UINT_MAX) {  // too big for a 32-bit header
+        return NULL;
+    }
+    block_t *b = mem_map(map_size(size));
+    if (b == NULL) {
+        return NULL;
+    }
+    b->size = map_size(size) | 1;  // the header covers the whole mapping
+    return b->payload;
+}
+
+/* map_realloc: resizes a large object's mapping
+arguments: ptr: the payload of the large object
+           size: the new payload size, at least MMAP_THRESHOLD
+returns: a pointer to the moved payload, or NULL if the mapping could not
+         be resized
+*/
+static void *map_realloc(void *ptr, long size) {
+    if (map_size(size) > UINT_MAX) {  // too big for a 32-bit header
+        return NULL;
+    }
+    block_t *b = mem_remap(payload_to_block(ptr), map_size(size));
+    if (b == NULL) {
+        return NULL;
+    }
+    b->size = map_size(size) | 1;
+    return b->payload;
+}
+
+/* map_free: gives a large object's mapping back
+arguments: ptr: the payload of the large object
+returns: nothing
+*/
+static void map_free(void *ptr) { mem_unmap(payload_to_block(ptr)); }
+
+/* split: splits a free block into a free block and an allocated block
+arguments: b: the block to allocate
+           free: the free block to split
+           size: the size of the allocated block
+returns: a pointer to the newly allocated block
+*/
+
+block_t *split(block_t *b, block_t *free, long size) {
+    STAT(splits, 1);
+    long diff = block_size(free) - size;  // determine new size of free block
+
+    pull_free_block(free);  // shrinking may move free to another size class
+    block_set_size(free, diff);
+    insert_free_block(free);
+    b = block_next(free);                      // set pointer for b
+    block_set_size_and_allocated(b, size, 1);  // set size and allocated for b
+    block_set_prev_allocated(b, 0);
+    block_set_prev_allocated(block_next(b), 1);
+
+    return b;
+}
+
+/* carve_batch: allocates equal blocks side by side out of one free block
+arguments: fb: the free block, already pulled from the free index
+           bsize: the size of each block, including its tags
+           n: how many blocks to allocate
+           out: where to store the n payloads, in address order
+           rest_low: 1 to leave the unused part of fb free below the blocks,
+           0 to leave it free above them
+returns: nothing
+NOTE: fb must hold at least n * bsize bytes
+*/
+static void carve_batch(block_t *fb, long bsize, long n, void **out,
+                        int rest_low) {
+    long rest = block_size(fb) - n * bsize;
+    int zeroed = block_zeroed(fb);
+    int prev_allocated = block_prev_allocated(fb);
+    block_t *b = fb;
+    if (rest >= MINBLOCKSIZE && rest_low) {  // the rest stays free below
+        block_set_size_and_allocated(fb, rest, 0);
+        block_set_zeroed(fb, zeroed);
+        insert_free_block(fb);
+        b = block_next(fb);
+        prev_allocated = 0;
+    }
+    for (long i = 0; i < n; i++) {
+        long size = bsize;
+        if (i == n - 1 && rest < MINBLOCKSIZE) {  // too small to split off
+            size += rest;
+        }
+        block_set_size_and_allocated(b, size, 1);
+        block_set_prev_allocated(b, prev_allocated);
+        prev_allocated = 1;
+        out[i] = b->payload;
+        b = block_next(b);
+    }
+    if (rest >= MINBLOCKSIZE && !rest_low) {  // the rest stays on top
+        block_set_size_and_allocated(b, rest, 0);
+        block_set_prev_allocated(b, 1);
+        block_set_zeroed(b, zeroed);
+        insert_free_block(b);
+    } else {
+        block_set_prev_allocated(b, 1);
+    }
+}
+
+#if SIZE_INDEX
+/* index_fit: finds a block in one size class that can hold a block of the
+given size, by the PLACEMENT policy, from the class's size index
+arguments: class: the size class to search, whose index covers all its blocks
+           size: the size of the block to allocate, including its tags
+returns: the same block a walk of the class's list would find, or NULL if the
+         class has none
+NOTE: the index is scanned from its end, which is the head of the list.
+FIT_BUDGET only limits list walks, since a scan reads no block headers
+*/
+static block_t *index_fit(int class, long size) {
+    int *sizes = findex->index_size[class];
+    int best = -1;
+    int done = 0;
+#if PLACEMENT == FIT_GOOD
+    int fits = 0;
+#endif
+    for (int chunk = (findex->index_count[class] - 1) & ~7; chunk >= 0 && !done;
+         chunk -= 8) {
+        // one compare looks at every block in the chunk
+        STAT_PROBES(findex->index_count[class] - chunk < 8
+                        ? findex->index_count[class] - chunk
+                        : 8);
+        unsigned int mask = size_index_fits(&sizes[chunk], size);
+        while (mask != 0 && !done) {  // the fits in this chunk, newest first
+            int i = chunk + 31 - __builtin_clz(mask);
+            mask &= ~(1U << (i - chunk));
+#if PLACEMENT == FIT_FIRST
+            best = i;
+            done = 1;
+#else
+            if (best == -1 || sizes[i] < sizes[best]) {
+                best = i;
+            }
+            if (sizes[i] - size <=
+                size * FIT_SLACK / 100) {  // close enough to stop looking
+                done = 1;
+            }
+#if PLACEMENT == FIT_GOOD
+            if (++fits == GOOD_FIT_PROBES) {
+                done = 1;
+            }
+#endif
+#endif
+        }
+    }
+    if (best == -1) {
+        return NULL;
+    }
+    return (block_t *)(findex->base + findex->index_offset[class][best]);
+}
+#endif
+
+/* class_fit: finds a block in one size class's free list that can hold a
+block of the given size, by the PLACEMENT policy
+arguments: class: the size class to search, whose list is not empty
+           size: the size of the block to allocate, including its tags
+returns: a pointer to a large enough free block, or NULL if the class has
+         none
+*/
+static block_t *class_fit(int class, long size) {
+#if SIZE_INDEX
+    if (findex->index_count[class] <= SIZE_INDEX_SLOTS) {
+        return index_fit(class, size);
+    }
+#endif
+    block_t *start = findex->flist_first[class];
+#if PLACEMENT == FIT_NEXT
+    if (findex->rover[class] != NULL) {  // picks up where the last search ended
+        start = findex->rover[class];
+    }
+#endif
+    block_t *best = NULL;
+#if PLACEMENT == FIT_GOOD
+    int fits = 0;
+#endif
+#if FIT_BUDGET > 0
+    int probes = 0;
+#endif
+    block_t *cur = start;
+    do {
+        STAT_PROBE();
+        if (block_size(cur) >= size) {  // checks if free block fits
+#if PLACEMENT == FIT_FIRST || PLACEMENT == FIT_NEXT
+            best = cur;
+            break;
+#else
+            if (best == NULL || block_size(cur) < block_size(best)) {
+                best = cur;
+            }
+            if (block_size(cur) - size <=
+                size * FIT_SLACK / 100) {  // close enough to stop looking
+                break;
+            }
+#if PLACEMENT == FIT_GOOD
+            if (++fits == GOOD_FIT_PROBES) {
+                break;
+            }
+#endif
+#endif
+        }
+#if FIT_BUDGET > 0
+        if (++probes == FIT_BUDGET) {  // out of budget
+            break;
+        }
+#endif
+        cur = block_flink(cur);  // go to next free block in free list
+    } while (cur != start);
+#if PLACEMENT == FIT_NEXT
+    findex->rover[class] = best != NULL ? best : cur;
+#endif
+    return best;
+}
+
+/* find_fit: finds a free block that can hold a block of the given size
+arguments: size: the size of the block to allocate, including its tags
+returns: a pointer to a large enough free block, or NULL if there is none
+*/
+static block_t *find_fit(long size) {
+    if (size >= LARGE_BLOCK_SIZE) {  // large requests get the best fit
+        STAT_PROBE();
+        return tree_best_fit(size);
+    }
+#if BOUNDED_LATENCY
+    // rounds size up to the next class boundary so that every block in the
+    // class we land on (and every class above it) is big enough
+    int fl = (int)(8 * sizeof(long)) - 1 - __builtin_clzl(size);
+    long rounded = size + (1L << (fl - SL_INDEX_BITS)) - 1;
+    int class = -1;
+    if (rounded < LARGE_BLOCK_SIZE) {
+        class = next_free_class(size_class(rounded));
+    }
+#else
+    int class = size_class(size);
+    if (findex->flist_first[class] != NULL) {  // searches size's own class
+        block_t *fit = class_fit(class, size);
+        if (fit != NULL) {
+            return fit;
+        }
+    }
+    // every block in a larger class is big enough, so any head will do
+    if (class < NUM_SIZE_CLASSES - 1) {
+        class = next_free_class(class + 1);
+    } else {
+        class = -1;
+    }
+#if PLACEMENT == FIT_BEST
+    if (class != -1) {  // the smallest block of that class fits best
+        return class_fit(class, size);
+    }
+#endif
+#endif
+    STAT_PROBE();       // the smallest large block, or a larger class's head
+    if (class == -1) {  // no list has a fit, so take the smallest large block
+        return tree_best_fit(size);
+    }
+    return findex->flist_first[class];
+}
+
+/* clear_seam: zeroes the tags and links left inside a block by merging it
+arguments: upper: the upper of two merged free blocks, whose header is intact
+returns: nothing
+NOTE: this keeps a merge of two zeroed blocks zero (see block_zeroed)
+*/
+static void clear_seam(block_t *upper) {
+    long links = block_size(upper) / WORD_SIZE - 2;  // stops at the end tag
+    if (links > FREE_LINK_WORDS) {
+        links = FREE_LINK_WORDS;
+    }
+    // payload[-2] is the lower block's old end tag, payload[-1] the header
+    memset(&upper->payload[-2], 0, (2 + links) * WORD_SIZE);
+}
+
+/* coalesce: merge two free blocks if they are next to each other
+arguments: b: the block to coalesce with its neighbors
+returns: the merged free block, which has been put in the free list
+*/
+block_t *coalesce(block_t *b) {
+    int zeroed = block_zeroed(b);  // the merged block is zero if all parts are
+    if (!block_next_allocated(b)) {  // checks if the next block is free
+        long size = block_size(b);
+        block_t *next = block_next(b);
+        zeroed &= block_zeroed(next);
+        pull_free_block(next);  // pulls next block from free list
+        block_set_size_and_allocated(b, block_size(next) + size,
+                                     0);  // resets size of current block
+        if (zeroed) {
+            clear_seam(next);
+        }
+    }
+    if (!block_prev_allocated(b)) {  // checks if prev block is free
+        long size = block_size(b);
+        block_t *prev = block_prev(b);
+        zeroed &= block_zeroed(prev);
+        pull_free_block(prev);  // pulls prev from free list
+        block_set_size_and_allocated(prev, block_size(prev) + size,
+                                     0);  // resets size of prev
+        if (zeroed) {
+            clear_seam(b);
+        }
+        b = prev;  // sets pointer
+    }
+    block_set_zeroed(b, zeroed);
+    insert_free_block(b);
+    return b;
+}
+
+/* trim_heap: gives the top of the heap back to memlib if it is a large
+enough free block
+arguments: b: a free block that has just been coalesced
+returns: nothing
+*/
+static void trim_heap(block_t *b) {
+    if (block_next(b) != arena->epilogue) {
+        return;
+    }
+    if (ADAPTIVE_GROWTH && block_size(b) >= arena->grow_chunk &&
+        arena->grow_chunk > GROW_MIN) {  // the last chunk was too big
+        arena->grow_chunk /= 2;
+    }
+    if (block_size(b) < TRIM_THRESHOLD) {
+        return;
+    }
+    long size = block_size(b);
+    pull_free_block(b);
+    mem_region_sbrk(arena->region, -size);
+    arena->epilogue = b;  // b's previous block is allocated, since b is free
+    block_set_size_and_allocated(arena->epilogue, TAGS_SIZE, 1);
+}
+
+/* free_block: frees an allocated block and merges it with its neighbors
+arguments: b: the block to free
+returns: nothing
+*/
+static void free_block(block_t *b) {
+    block_set_allocated(b, 0);
+    block_set_prev_allocated(block_next(b), 0);
+    STAT(coalesce_prev, !block_prev_allocated(b) && block_next_allocated(b));
+    STAT(coalesce_next, block_prev_allocated(b) && !block_next_allocated(b));
+    STAT(coalesce_both, !block_prev_allocated(b) && !block_next_allocated(b));
+
+    if (block_prev_allocated(b) &&
+        block_next_allocated(b)) {  // checks if prev and next are allocated
+        insert_free_block(b);
+    } else {  // else coalesce
+        b = coalesce(b);
+    }
+    trim_heap(b);
+}
+
+/* quick_consolidate: frees every block on the current arena's quick lists,
+coalescing each with its free neighbors
+arguments: none
+returns: nothing
+NOTE: called once a search misses, before the heap grows, and before any
+search that only a merged block could satisfy
+*/
+static void quick_consolidate(void) {
+    if (arena->quick_bytes == 0) {
+        return;
+    }
+    for (int i = 0; i < QUICK_BINS; i++) {
+        while (arena->quick[i] != NULL) {
+            void *ptr = arena->quick[i];
+            arena->quick[i] = *(void **)ptr;
+            free_block(payload_to_block(ptr));
+        }
+    }
+    arena->quick_bytes = 0;
+}
+
+/* extend_heap: grows the heap by a free block, merged with the block below it
+arguments: size: the number of bytes to grow the heap by
+returns: the free block at the top of the heap, or NULL if the heap could not
+         grow by size
+*/
+static block_t *extend_heap(long size) {
+    if (size > INT_MAX) {  // mem_region_sbrk takes an int
+        return NULL;
+    }
+    if (mem_region_sbrk(arena->region, size) ==
+        (void *)-1) {  // error checks mem_sbrk
+        return NULL;
+    }
+    STAT(sbrks, 1);
+    STAT(sbrk_bytes, size);
+    block_t *b =
+        arena->epilogue;  // the new block starts where the epilogue was
+    block_set_size_and_allocated(b, size, 0);
+    block_set_zeroed(b, 1);  // memlib hands out zero-filled memory
+    arena->epilogue = block_next(b);
+    block_set_size_and_allocated(arena->epilogue, TAGS_SIZE, 1);
+    block_set_prev_allocated(arena->epilogue, 0);
+    return coalesce(b);
+}
+
+/* aligned_lead: finds where an aligned block can start inside a free block
+arguments: fb: the free block
+           alignment: the required payload alignment, a power of two
+returns: the number of bytes between fb and the aligned block. This is 0 or
+         enough for the leading bytes to form a free block of their own
+*/
+static long aligned_lead(block_t *fb, long alignment) {
+    unsigned long payload = (unsigned long)fb->payload;
+    long lead =
+        (long)(((payload + alignment - 1) & ~(alignment - 1)) - payload);
+    while (lead != 0 && lead < MINBLOCKSIZE) {  // too small to be a block
+        lead += alignment;
+    }
+    return lead;
+}
+
+/* place_aligned: allocates a block with an aligned payload out of a free block
+arguments: fb: the free block to carve the new block from
+           size: the size of the block to allocate, including its tags
+           alignment: the required payload alignment, a power of two
+returns: the newly allocated block, or NULL if fb is too small. Any space
+         before and after the new block goes back in the free list
+*/
+static block_t *place_aligned(block_t *fb, long size, long alignment) {
+    long fb_size = block_size(fb);
+    long lead = aligned_lead(fb, alignment);
+    if (lead + size > fb_size) {  // no aligned block of size fits in fb
+        return NULL;
+    }
+    long tail = fb_size - lead - size;
+    if (tail < MINBLOCKSIZE) {  // too small to split off, so keep it
+        size += tail;
+        tail = 0;
+    }
+
+    pull_free_block(fb);
+    block_t *b = fb;
+    if (lead > 0) {  // the leading fragment stays free
+        block_set_size_and_allocated(fb, lead, 0);
+        insert_free_block(fb);
+        b = block_next(fb);
+        block_set_size_and_allocated(b, size, 1);
+        block_set_prev_allocated(b, 0);
+    } else {
+        block_set_size_and_allocated(b, size, 1);
+    }
+    block_t *next = block_next(b);
+    if (tail > 0) {  // so does the trailing one
+        block_set_size_and_allocated(next, tail, 0);
+        block_set_prev_allocated(next, 1);
+        insert_free_block(next);
+    } else {
+        block_set_prev_allocated(next, 1);
+    }
+    return b;
+}
+
+/* alloc_aligned_block: allocates a block whose payload is aligned
+arguments: size: the size of the block to allocate, including its tags
+           alignment: the required payload alignment, a power of two
+returns: the newly allocated block, or NULL if the heap could not grow
+*/
+static block_t *alloc_aligned_block(long size, long alignment) {
+    quick_consolidate();
+    block_t *fit = find_fit(size);
+    if (fit != NULL) {  // an ordinary fit may happen to be placed well
+        block_t *b = place_aligned(fit, size, alignment);
+        if (b != NULL) {
+            return b;
+        }
+    }
+    // any block this big has an aligned block of size in it somewhere
+    fit = find_fit(size + alignment + MINBLOCKSIZE);
+    if (fit != NULL) {
+        return place_aligned(fit, size, alignment);
+    }
+
+    // grows the heap just enough for the top free block (or the new block,
+    // if the top block is allocated) to hold an aligned block of size
+    block_t *top = arena->epilogue;
+    if (!block_prev_allocated(arena->epilogue)) {
+        top = block_prev(arena->epilogue);
+    }
+    char *end = (char *)top + aligned_lead(top, alignment) + size;
+    long grow = end - (char *)arena->epilogue;
+    if (grow < MINBLOCKSIZE) {
+        grow = MINBLOCKSIZE;
+    }
+    block_t *fb = extend_heap(grow);
+    if (fb == NULL) {
+        return NULL;
+    }
+    return place_aligned(fb, size, alignment);
+}
+
+/* run_of: finds the run that a slot belongs to
+arguments: ptr: a pointer to the slot
+returns: a pointer to the header of the slot's run
+*/
+static inline run_t *run_of(void *ptr) {
+    return (run_t *)((unsigned long)ptr & ~(unsigned long)(RUN_SIZE - 1));
+}
+
+/* run_page: finds which page of an arena a pointer is in
+arguments: a: the arena ptr lies in
+           ptr: a pointer into the arena's heap
+returns: the index of ptr's page in a's run_pages
+*/
+static inline long run_page(arena_t *a, void *ptr) {
+    return (long)((unsigned long)ptr / RUN_SIZE -
+                  (unsigned long)mem_region_lo(a->region) / RUN_SIZE);
+}
+
+/* in_run: checks whether a payload pointer is a slot in a run
+arguments: a: the arena ptr lies in
+           ptr: a pointer returned by mm_malloc or mm_realloc
+returns: 1 if ptr is a slot in a run, 0 if it is the payload of a block
+*/
+static inline int in_run(arena_t *a, void *ptr) {
+    return a->run_pages[run_page(a, ptr)];
+}
+
+/* run_unlink: takes a run off the list of partially free runs
+arguments: run: the run to take off its list
+returns: nothing
+*/
+static void run_unlink(run_t *run) {
+    int class = run->slot_size / SLAB_CLASS_SIZE - 1;
+    if (run->prev != NULL) {
+        run->prev->next = run->next;
+    } else {  // run is the head of its list
+        arena->partial_runs[class] = run->next;
+    }
+    if (run->next != NULL) {
+        run->next->prev = run->prev;
+    }
+}
+
+/* run_push: puts a run at the head of the list of partially free runs
+arguments: run: the run to put on its list
+returns: nothing
+*/
+static void run_push(run_t *run) {
+    int class = run->slot_size / SLAB_CLASS_SIZE - 1;
+    run->prev = NULL;
+    run->next = arena->partial_runs[class];
+    if (run->next != NULL) {
+        run->next->prev = run;
+    }
+    arena->partial_runs[class] = run;
+}
+
+/* new_run: sets up an empty run of slots in a newly allocated block
+arguments: class: the slot size class of the run
+returns: the new run, or NULL if the heap could not grow
+*/
+static run_t *new_run(int class) {
+    block_t *b = alloc_aligned_block(RUN_SIZE + ALLOC_TAGS_SIZE, RUN_SIZE);
+    if (b == NULL) {
+        return NULL;
+    }
+    run_t *run = (run_t *)b->payload;
+    run->slot_size = (class + 1) * SLAB_CLASS_SIZE;
+    run->num_slots = (RUN_SIZE - sizeof(run_t)) / run->slot_size;
+    run->num_free = run->num_slots;
+    memset(run->free_map, 0, sizeof(run->free_map));
+    for (int i = 0; i < run->num_slots; i++) {  // every slot starts out free
+        run->free_map[i / (8 * sizeof(long))] |= 1UL
+                                                 << (i % (8 * sizeof(long)));
+    }
+    arena->run_pages[run_page(arena, run)] = 1;
+    run_push(run);
+    return run;
+}
+
+/* slab_alloc: allocates a slot from a run
+arguments: size: the requested payload size, at most SLAB_MAX_SIZE
+returns: a pointer to the slot, or NULL if the heap could not grow
+*/
+static void *slab_alloc(long size) {
+    int class = (size - 1) / SLAB_CLASS_SIZE;
+    run_t *run = arena->partial_runs[class];
+    if (run == NULL) {  // every run of this size is full
+        run = new_run(class);
+        if (run == NULL) {
+            return NULL;
+        }
+    }
+    int word = 0;
+    while (run->free_map[word] == 0) {  // finds a word with a free slot
+        word++;
+    }
+    int bit = __builtin_ctzl(run->free_map[word]);
+    run->free_map[word] &= ~(1UL << bit);
+    run->num_free--;
+    if (run->num_free == 0) {  // run is full
+        run_unlink(run);
+    }
+    long slot = word * 8 * sizeof(long) + bit;
+    return (char *)run->slots + slot * run->slot_size;
+}
+
+/* slab_free: returns a slot to its run
+arguments: ptr: a pointer to the slot
+returns: nothing
+*/
+static void slab_free(void *ptr) {
+    run_t *run = run_of(ptr);
+    long slot = ((char *)ptr - (char *)run->slots) / run->slot_size;
+    run->free_map[slot / (8 * sizeof(long))] |= 1UL
+                                                << (slot % (8 * sizeof(long)));
+    run->num_free++;
+    if (run->num_free == 1) {  // run was full
+        run_push(run);
+    }
+    // empty runs go back to the heap, except for the last partial run of a
+    // size, so a single alloc/free pair does not build and tear down a run
+    if (run->num_free == run->num_slots &&
+        (run->next != NULL || run->prev != NULL)) {
+        run_unlink(run);
+        arena->run_pages[run_page(arena, run)] = 0;
+        free_block(payload_to_block(run));
+    }
+}
+
+/* grow_size: picks how much to grow the heap by for a request that no free
+block fits, and adapts the arena's chunk size to how often it grows
+arguments: size: the size of the block being allocated
+returns: the number of bytes to grow the heap by
+*/
+static long grow_size(long size) {
+    long chunk = GROW_MIN;
+#if ADAPTIVE_GROWTH
+    if (arena->mallocs_since_grow <= GROW_BURST &&
+        arena->grow_chunk < GROW_MAX) {  // growing in a burst
+        arena->grow_chunk *= 2;
+    } else if (arena->mallocs_since_grow >= GROW_QUIET &&
+               arena->grow_chunk > GROW_MIN) {  // growing rarely
+        arena->grow_chunk /= 2;
+    }
+    arena->mallocs_since_grow = 0;
+    chunk = arena->grow_chunk;
+#endif
+    return size > chunk ? size : chunk;
+}
+
+/* probe_bucket: finds which bucket of mm_stats_t's probe_hist a search falls
+in
+arguments: probes: how many free blocks the search probed, at least 1
+returns: ceil(log2(probes)), up to MM_PROBE_BUCKETS - 1 for everything past 64
+*/
+static inline int probe_bucket(long probes) {
+    if (probes <= 1) {
+        return 0;
+    }
+    int bucket = 64 - __builtin_clzl(probes - 1);  // ceil(log2(probes))
+    return bucket < MM_PROBE_BUCKETS ? bucket : MM_PROBE_BUCKETS - 1;
+}
+
+/* heap_alloc: allocates a block or slot from the shared heap
+arguments: size: the desired payload size
+           zeroed: set to 1 if the block came from memory known to be zero
+           (see block_zeroed), to 0 otherwise
+returns: a pointer to the payload, or NULL if an error occurred
+NOTE: the caller must hold the current arena's lock
+*/
+static void *heap_alloc(long size, int *zeroed) {
+    *zeroed = 0;
+    if (size == 0) {
+        return NULL;
+    }
+    if (size <= SLAB_MAX_SIZE) {  // small requests get a slot in a run
+        return slab_alloc(size);
+    }
+    size = align(size) + ALLOC_TAGS_SIZE;  // aligns and adds header
+    if (size < MINBLOCKSIZE) {  // free blocks need room for flink and blink
+        size = MINBLOCKSIZE;
+    }
+    block_t *new_block;
+    arena->mallocs_since_grow++;
+#if QUICK_LISTS
+    if (size <= QUICK_MAX_SIZE &&
+        arena->quick[size / ALIGNMENT] != NULL) {  // an exact fit, unsplit
+        void *ptr = arena->quick[size / ALIGNMENT];
+        arena->quick[size / ALIGNMENT] = *(void **)ptr;
+        arena->quick_bytes -= size;
+        return ptr;
+    }
+#endif
+
+#if MM_STATS
+    arena->probes = 0;
+#endif
+    block_t *fit = find_fit(size);
+    if (fit == NULL && arena->quick_bytes > 0) {  // a miss merges them back
+        quick_consolidate();
+        fit = find_fit(size);
+    }
+    if (fit != NULL) {
+        STAT(probe_hist[probe_bucket(arena->probes)], 1);
+        *zeroed = block_zeroed(fit);
+        if (block_size(fit) - size >=
+            MINBLOCKSIZE) {  // checks if free block is big enough to split
+            new_block = NULL;
+            new_block = split(new_block, fit, size);  // splits free block
+            return new_block->payload;
+        } else {  // free block is big enough, but not big enough to split
+            pull_free_block(fit);
+            block_set_allocated(fit, 1);
+            block_set_prev_allocated(block_next(fit), 1);
+            return fit->payload;
+        }
+    }
+    // if the top block is free, the heap only has to grow by what it lacks
+    long top_free = 0;
+    if (!block_prev_allocated(arena->epilogue)) {
+        top_free = block_size(block_prev(arena->epilogue));
+    }
+    long grow = grow_size(size) - top_free;
+    if (grow < MINBLOCKSIZE) {
+        grow = MINBLOCKSIZE;
+    }
+    block_t *top = extend_heap(grow);  // merged with the old top block
+    if (top == NULL) {                 // error checks mem_sbrk
+        return NULL;
+    }
+    pull_free_block(top);
+    *zeroed = block_zeroed(top);
+
+    if (block_size(top) - size >= MINBLOCKSIZE) {  // check if we can split
+        STAT(splits, 1);
+        // the rest stays on top, where the next extension or a growing
+        // realloc can take it
+        long rest_size = block_size(top) - size;
+        block_set_size_and_allocated(top, size, 1);
+        block_t *rest = block_next(top);
+        block_set_size_and_allocated(rest, rest_size, 0);
+        block_set_prev_allocated(rest, 1);
+        block_set_zeroed(rest, *zeroed);
+        insert_free_block(rest);
+    } else {  // no splitting
+        block_set_allocated(top, 1);
+        block_set_prev_allocated(arena->epilogue, 1);
+    }
+    return top->payload;
+}
+
+/* heap_malloc: allocates a block or slot from the shared heap
+arguments: size: the desired payload size
+returns: a pointer to the payload, or NULL if an error occurred
+NOTE: the caller must hold the current arena's lock
+*/
+static void *heap_malloc(long size) {
+    int zeroed;
+    return heap_alloc(size, &zeroed);
+}
+
+/* heap_free: returns a block or slot to the shared heap
+arguments: ptr: pointer to the block's payload
+returns: nothing
+NOTE: the caller must hold the current arena's lock
+*/
+static void heap_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (in_run(arena, ptr)) {  // slots go back to their run
+        slab_free(ptr);
+        return;
+    }
+    block_t *b = payload_to_block(ptr);
+#if QUICK_LISTS
+    if (block_size(b) <= QUICK_MAX_SIZE) {  // coalescing waits
+        *(void **)ptr = arena->quick[block_size(b) / ALIGNMENT];
+        arena->quick[block_size(b) / ALIGNMENT] = ptr;
+        arena->quick_bytes += block_size(b);
+        if (arena->quick_bytes > QUICK_MAX_BYTES) {
+            quick_consolidate();
+        }
+        return;
+    }
+#endif
+    free_block(b);
+}
+
+/* heap_malloc_batch: allocates several blocks or slots of the same size
+arguments: size: the desired payload size of each
+           n: how many to allocate
+           out: where to store the payloads
+returns: how many were allocated, which is less than n only if the heap ran
+         out of memory
+NOTE: blocks are carved side by side out of one free block, or out of the top
+of the heap after a single extension. The caller must hold the current arena's
+lock
+*/
+static long heap_malloc_batch(long size, long n, void **out) {
+    long bsize = align(size) + ALLOC_TAGS_SIZE;
+    if (bsize < MINBLOCKSIZE) {
+        bsize = MINBLOCKSIZE;
+    }
+    // a batch bigger than a whole region goes block by block, and runs out
+    if (size > SLAB_MAX_SIZE && n <= MAX_HEAP / bsize) {
+        long total = n * bsize;
+        arena->mallocs_since_grow += n;
+        quick_consolidate();
+        block_t *fit = find_fit(total);
+        if (fit != NULL) {
+            pull_free_block(fit);
+            carve_batch(fit, bsize, n, out, 1);
+            return n;
+        }
+        long top_free = 0;
+        if (!block_prev_allocated(arena->epilogue)) {
+            top_free = block_size(block_prev(arena->epilogue));
+        }
+        long grow = grow_size(total) - top_free;
+        if (grow < MINBLOCKSIZE) {
+            grow = MINBLOCKSIZE;
+        }
+        block_t *top = extend_heap(grow);
+        if (top != NULL) {
+            pull_free_block(top);
+            carve_batch(top, bsize, n, out, 0);
+            return n;
+        }
+    }
+    // slots come from runs one at a time, and so does a batch that cannot
+    // fit side by side
+    for (long i = 0; i < n; i++) {
+        if ((out[i] = heap_malloc(size)) == NULL) {
+            return i;
+        }
+    }
+    return n;
+}
+
+/* adjacent: checks whether one block starts right where another ends
+arguments: a: the arena both payloads belong to
+           lo: the payload of the lower block
+           hi: the payload of the block that may follow it
+returns: 1 if hi's block follows lo's block in memory, 0 otherwise (or if
+         either one is a slot in a run)
+*/
+static int adjacent(arena_t *a, void *lo, void *hi) {
+    if (in_run(a, lo) || in_run(a, hi)) {
+        return 0;
+    }
+    return block_next(payload_to_block(lo))->payload == hi;
+}
+
+/* heap_free_batch: frees several blocks or slots of the current arena
+arguments: ptrs: the payloads to free
+           n: how many there are
+returns: nothing
+NOTE: blocks that follow each other in memory, in the order given, are merged
+into one block first, so their run is coalesced only once. The caller must
+hold the current arena's lock
+*/
+static void heap_free_batch(void **ptrs, long n) {
+    for (long i = 0; i < n; i++) {
+        if (in_run(arena, ptrs[i])) {
+            slab_free(ptrs[i]);
+            continue;
+        }
+        block_t *b = payload_to_block(ptrs[i]);
+        long size = block_size(b);
+        while (i + 1 < n && adjacent(arena, ptrs[i], ptrs[i + 1])) {
+            size += block_size(payload_to_block(ptrs[++i]));
+        }
+        block_set_size(b, size);
+        free_block(b);
+    }
+}
+
+/* growth_streak: finds how many times in a row a block has grown
+arguments: ptr: the payload of the block
+returns: the number of growing reallocs ptr has had in a row
+*/
+static int growth_streak(void *ptr) {
+    for (int i = 0; i < GROWTH_SLOTS; i++) {
+        if (arena->growth[i].ptr == ptr) {
+            return arena->growth[i].streak;
+        }
+    }
+    return 0;
+}
+
+/* note_growth: records the outcome of a realloc in the growth tracker
+arguments: old_ptr: the payload passed to mm_realloc
+           new_ptr: the payload mm_realloc returned
+           grew: 1 if the realloc asked for more room than the block had
+returns: nothing
+*/
+static void note_growth(void *old_ptr, void *new_ptr, int grew) {
+    for (int i = 0; i < GROWTH_SLOTS; i++) {
+        if (arena->growth[i].ptr == old_ptr) {
+            if (grew && new_ptr != NULL) {  // still growing
+                arena->growth[i].ptr = new_ptr;
+                arena->growth[i].streak++;
+            } else {  // stopped growing
+                arena->growth[i].ptr = NULL;
+                arena->growth[i].streak = 0;
+            }
+            return;
+        }
+    }
+    if (grew && new_ptr != NULL) {  // a new block starts growing
+        growth_t *slot = &arena->growth[arena->growth_victim];
+        slot->ptr = new_ptr;
+        slot->streak = 1;
+        arena->growth_victim = (arena->growth_victim + 1) % GROWTH_SLOTS;
+    }
+}
+
+/* alloc_at_top: allocates a block as the last block of the heap, growing the
+heap as needed, so the block can later grow in place
+arguments: size: the size of the block, including its header
+returns: the new block, or NULL if the heap could not grow
+*/
+static block_t *alloc_at_top(long size) {
+    long top_free = 0;
+    if (!block_prev_allocated(arena->epilogue)) {
+        top_free = block_size(block_prev(arena->epilogue));
+    }
+    if (top_free < size) {  // the top block is too small (or allocated)
+        long grow = size - top_free;
+        if (grow < MINBLOCKSIZE) {
+            grow = MINBLOCKSIZE;
+        }
+        if (extend_heap(grow) == NULL) {
+            return NULL;
+        }
+    }
+    block_t *top = block_prev(arena->epilogue);
+    if (block_size(top) - size >= MINBLOCKSIZE) {  // takes the high end
+        return split(NULL, top, size);
+    }
+    pull_free_block(top);
+    block_set_allocated(top, 1);
+    block_set_prev_allocated(arena->epilogue, 1);
+    return top;
+}
+
+/* heap_realloc: resizes a block or slot in the shared heap
+arguments: ptr: a pointer to the memory block's payload
+           size: the desired new payload size
+returns: a pointer to the new memory block's payload
+NOTE: the caller must hold the current arena's lock
+*/
+static void *heap_realloc(void *ptr, long size) {
+    if (ptr == NULL) {
+        return heap_malloc(size);
+    }
+    if (size == 0) {
+        heap_free(ptr);
+        return NULL;
+    }
+    STAT(realloc_in_place, 1);  // until it turns out to move
+
+    if (in_run(arena, ptr)) {  // slots can only grow by moving to a bigger one
+        long slot_size = run_of(ptr)->slot_size;
+        if (size <= slot_size) {
+            return ptr;
+        }
+        void *new_ptr = heap_malloc(size);
+        if (new_ptr == NULL) {  // error check malloc
+            return NULL;
+        }
+        memcpy(new_ptr, ptr, slot_size);
+        STAT_MOVE(slot_size);
+        slab_free(ptr);
+        return new_ptr;
+    }
+
+    block_t *cur = payload_to_block(ptr);
+    long cur_b_size = block_size(cur);
+    long nsize = align(size) + ALLOC_TAGS_SIZE;
+    if (nsize < MINBLOCKSIZE) {  // free blocks need room for flink and blink
+        nsize = MINBLOCKSIZE;
+    }
+    if (nsize > cur_b_size) {  // growing in place needs free neighbors
+        quick_consolidate();
+    }
+    if (nsize <= cur_b_size) {  // checks if we are decreasing size
+        if (cur_b_size - nsize >= MINBLOCKSIZE) {  // check if we can split
+            block_set_size(cur, nsize);
+            block_t *rest = block_next(cur);
+            block_set_size_and_allocated(rest, cur_b_size - nsize, 0);
+            block_set_prev_allocated(rest, 1);
+            block_set_prev_allocated(block_next(rest), 0);
+            trim_heap(coalesce(rest));  // rest may border a free block
+        }
+        return cur->payload;
+
+    } else {  // nsize is bigger than current size
+        int growing = growth_streak(ptr) >= GROWTH_STREAK;
+        if (!block_next_allocated(cur)) {  // checks if next block is free
+            long tot_size = block_next_size(cur) + cur_b_size;
+            long diff = tot_size - nsize;
+            if (diff >= 0) {  // checks if next block has enough space
+                if (diff >= MINBLOCKSIZE) {  // check if we can split
+                    pull_free_block(block_next(cur));
+                    block_set_size(cur, nsize);
+                    block_set_size_and_allocated(block_next(cur), diff, 0);
+                    block_set_prev_allocated(block_next(cur), 1);
+                    insert_free_block(block_next(cur));
+                } else {  // if we can't split
+                    pull_free_block(block_next(cur));
+                    block_set_size(cur, tot_size);
+                    block_set_prev_allocated(block_next(cur), 1);
+                }
+                return cur->payload;
+            }
+        }
+
+        // at the top of the heap (with at most a free block between cur and
+        // the epilogue), the heap can grow under cur instead of cur moving
+        block_t *after = block_next(cur);
+        if (after == arena->epilogue ||
+            (!block_allocated(after) && block_next(after) == arena->epilogue)) {
+            long have = cur_b_size;
+            if (after != arena->epilogue) {
+                have += block_size(after);
+            }
+            long grow = nsize - have;
+            if (growing) {  // leaves room for the next few growths
+                grow += nsize / GROWTH_HEADROOM;
+            }
+            if (grow < MINBLOCKSIZE) {
+                grow = MINBLOCKSIZE;
+            }
+            grow = align(grow);
+            block_t *top = extend_heap(grow);  // merged with after, if free
+            if (top == NULL) {                 // error checks mem_sbrk
+                return NULL;
+            }
+            pull_free_block(top);
+            long tot_size = cur_b_size + block_size(top);
+            if (tot_size - nsize >= MINBLOCKSIZE) {  // check if we can split
+                block_set_size(cur, nsize);
+                block_t *rest = block_next(cur);
+                block_set_size_and_allocated(rest, tot_size - nsize, 0);
+                block_set_prev_allocated(rest, 1);
+                insert_free_block(rest);
+            } else {  // if we can't split
+                block_set_size(cur, tot_size);
+                block_set_prev_allocated(arena->epilogue, 1);
+            }
+            return cur->payload;
+        }
+
+        // the prev block's end tag sits right below cur, and every new
+        // header written below lies inside prev, so no payload is clobbered
+        // before it is moved
+        if (!block_prev_allocated(cur)) {  // checks if prev is free
+            long tot_size = block_size(block_prev(cur)) + cur_b_size;
+            long diff = tot_size - nsize;
+            void *ret;
+            if (diff >= 0) {  // check if prev has enough space
+                block_t *prev = block_prev(cur);
+                pull_free_block(prev);
+                if (diff >= MINBLOCKSIZE) {  // check if we can split
+                    block_set_size(prev, diff);
+                    insert_free_block(prev);
+                    block_t *moved = block_next(prev);
+                    block_set_size_and_allocated(moved, nsize, 1);
+                    block_set_prev_allocated(moved, 0);
+                    ret = memmove(moved->payload, ptr,
+                                  cur_b_size - ALLOC_TAGS_SIZE);
+                } else {  // if we can't split
+                    block_set_size_and_allocated(prev, tot_size, 1);
+                    ret = memmove(prev->payload, ptr,
+                                  cur_b_size - ALLOC_TAGS_SIZE);
+                }
+                STAT_MOVE(cur_b_size - ALLOC_TAGS_SIZE);
+                return ret;
+            }
+        }
+        if (!block_next_allocated(cur) &&
+            !block_prev_allocated(cur)) {  // check if next and prev and free
+            long tot_size =
+                block_next_size(cur) + block_prev_size(cur) + cur_b_size;
+            long diff = tot_size - nsize;
+            void *ret;
+            if (diff >= 0) {  // checks if next and prev have enough space
+                block_t *prev = block_prev(cur);
+                pull_free_block(block_next(cur));
+                pull_free_block(prev);
+                if (diff >= MINBLOCKSIZE) {  // check if we can split
+                    block_set_size(prev, diff);
+                    insert_free_block(prev);
+                    block_t *moved = block_next(prev);
+                    block_set_size_and_allocated(moved, nsize, 1);
+                    block_set_prev_allocated(moved, 0);
+                    ret = memmove(moved->payload, ptr,
+                                  cur_b_size - ALLOC_TAGS_SIZE);
+                } else {  // if we can't split
+                    block_set_size_and_allocated(prev, tot_size, 1);
+                    ret = memmove(prev->payload, ptr,
+                                  cur_b_size - ALLOC_TAGS_SIZE);
+                }
+                // the block after the old next block now follows an
+                // allocated block
+                block_t *grown = payload_to_block(ret);
+                block_set_prev_allocated(block_next(grown), 1);
+                STAT_MOVE(cur_b_size - ALLOC_TAGS_SIZE);
+                return ret;
+            }
+        }
+        if (growing) {  // moves to the top, where it can keep growing
+            block_t *moved = alloc_at_top(nsize);
+            if (moved == NULL) {
+                return NULL;
+            }
+            memcpy(moved->payload, ptr, cur_b_size - ALLOC_TAGS_SIZE);
+            STAT_MOVE(cur_b_size - ALLOC_TAGS_SIZE);
+            heap_free(ptr);
+            return moved->payload;
+        }
+        block_t *new_block = heap_malloc(size);
+        if (new_block == NULL) {  // error check malloc
+            return NULL;
+        }
+        new_block = memmove(new_block, ptr, cur_b_size - ALLOC_TAGS_SIZE);
+        STAT_MOVE(cur_b_size - ALLOC_TAGS_SIZE);
+        heap_free(ptr);
+        return new_block;
+    }
+}
+
+/* remote_free: hands a block to its arena without taking the arena's lock
+arguments: a: the arena that owns ptr
+           ptr: the payload of the block or slot being freed
+returns: nothing
+NOTE: without REMOTE_QUEUE, this frees ptr under a's lock instead, so the
+caller must not hold another arena's lock
+*/
+static void remote_free(arena_t *a, void *ptr) {
+#if REMOTE_QUEUE
+    void *head = __atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED);
+    do {  // retries until no other thread pushed in between
+        *(void **)ptr = head;
+    } while (!__atomic_compare_exchange_n(&a->remote_frees, &head, ptr, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#else
+    if (arena_lock(a) == 0) {
+        heap_free(ptr);
+        arena_unlock(a);
+    }
+#endif
+}
+
+/* drain_remote_frees: frees every block other threads have queued on the
+current arena
+arguments: none
+returns: nothing
+NOTE: the caller must hold the current arena's lock
+*/
+static void drain_remote_frees(void) {
+    if (__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) == NULL) {
+        return;
+    }
+    // takes the whole queue at once, so pushes never race with the drain
+    void *ptr =
+        __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    while (ptr != NULL) {
+        void *next = *(void **)ptr;
+        heap_free(ptr);
+        ptr = next;
+    }
+}
 
-    void *holder = mem_sbrk(TAGS_SIZE);  // allocated space for the prologue
+// Each thread keeps a few recently freed slots and small blocks, binned by
+// TCACHE_BIN_SIZE bytes of payload, so that most small mallocs and frees never
+// take an arena's lock. Cached blocks may come from any arena.
+// Cached blocks stay allocated as far as the heap can tell;
+// they are linked through their first payload word.
+#define TCACHE_BIN_SIZE 16
+#define TCACHE_BINS 16
+#define TCACHE_MAX_SIZE (TCACHE_BINS * TCACHE_BIN_SIZE)
+#define TCACHE_COUNT 7
 
-    if (holder == (void *)-1) {  // error checking mem_sbrk
-        return -1;
-    } else {  // setting size, allocated, and pointer for prologue
-        prologue = holder;
-        block_set_size_and_allocated(prologue, TAGS_SIZE, 1);
-    }
+typedef struct tcache {
+    unsigned long generation;  // heap_generation when the cache was filled
+    int registered;            // set once the exit destructor is registered
+    int counts[TCACHE_BINS];
+    void *bins[TCACHE_BINS];
+} tcache_t;
 
-    void *holder2 = mem_sbrk(TAGS_SIZE);  // allocated space for the epilogue
+static __thread tcache_t tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
 
-    if (holder2 == (void *)-1) {  // error checking mem_sbrk
-        return -1;
-    } else {  // setting size, allocated, and pointer for epilogue
-        epilogue = holder2;
-        block_set_size_and_allocated(epilogue, TAGS_SIZE, 1);
+/* tcache_flush: hands every block in a thread's cache back to its arena
+arguments: cache: the cache to empty
+returns: nothing
+*/
+static void tcache_flush(void *cache) {
+    tcache_t *tc = cache;
+    if (tc->generation == heap_generation) {  // blocks belong to this heap
+        arena_t *locked = NULL;
+        for (int i = 0; i < TCACHE_BINS; i++) {
+            while (tc->bins[i] != NULL) {
+                void *ptr = tc->bins[i];
+                tc->bins[i] = *(void **)ptr;
+                arena_t *a = arena_of(ptr);
+                if (a != locked) {  // keeps the lock across runs of one arena
+                    if (locked != NULL) {
+                        arena_unlock(locked);
+                    }
+                    arena_lock(a);
+                    locked = a;
+                }
+                heap_free(ptr);
+            }
+        }
+        if (locked != NULL) {
+            arena_unlock(locked);
+        }
     }
-    return 0;
+    memset(tc->bins, 0, sizeof(tc->bins));
+    memset(tc->counts, 0, sizeof(tc->counts));
 }
 
-/* split: splits a free block into a free block and an allocated block
-arguments: b: the block to allocate
-           free: the free block to split
-           size: the size of the allocated block
-returns: a pointer to the newly allocated block
+/* tcache_make_key: creates the key whose destructor flushes a thread's cache
+arguments: none
+returns: nothing
 */
+static void tcache_make_key(void) {
+    pthread_key_create(&tcache_key, tcache_flush);
+}
 
-block_t *split(block_t *b, block_t *free, long size) {
-    long diff = block_size(free) - size;  // determine new size of free block
+/* tcache_get: finds the calling thread's cache, emptying it first if it was
+filled from a heap that mm_init has since thrown away
+arguments: none
+returns: a pointer to the calling thread's cache
+*/
+static tcache_t *tcache_get(void) {
+    tcache_t *tc = &tcache;
+    if (!tc->registered) {  // first call on this thread
+        pthread_once(&tcache_key_once, tcache_make_key);
+        pthread_setspecific(tcache_key, tc);
+        tc->registered = 1;
+    }
+    if (tc->generation != heap_generation) {  // stale blocks are just dropped
+        memset(tc->bins, 0, sizeof(tc->bins));
+        memset(tc->counts, 0, sizeof(tc->counts));
+        tc->generation = heap_generation;
+    }
+    return tc;
+}
 
-    block_set_size(free, diff);
-    b = block_next(free);                      // set pointer for b
-    block_set_size_and_allocated(b, size, 1);  // set size and allocated for b
+/* usable_size: finds how many payload bytes a block or slot has
+arguments: a: the arena ptr belongs to
+           ptr: a pointer returned by mm_malloc or mm_realloc
+returns: the number of bytes the caller may use at ptr
+NOTE: this runs without the arena's lock, while a thread holding it may flip
+the prev-allocated bit in the same header word, so the word is read
+atomically (see block_set_prev_allocated)
+*/
+static long usable_size(arena_t *a, void *ptr) {
+    if (in_run(a, ptr)) {
+        return run_of(ptr)->slot_size;
+    }
+    unsigned int header =
+        __atomic_load_n(&payload_to_block(ptr)->size, __ATOMIC_RELAXED);
+    return (header & -8) - ALLOC_TAGS_SIZE;
+}
 
-    return b;
+/* tcache_put: keeps a freed block or slot in the calling thread's cache
+arguments: ptr: the payload, which belongs to the thread's home arena
+           usable: how many bytes the caller may use at ptr, or any smaller
+           number
+returns: 1 if ptr was cached, 0 if it is too big or its bin is full
+*/
+static int tcache_put(void *ptr, long usable) {
+    // a block in bin i has at least (i + 1) * TCACHE_BIN_SIZE usable bytes,
+    // which is enough for any request mm_malloc looks up in bin i
+    long bin = usable / TCACHE_BIN_SIZE - 1;
+    if (bin < 0 || bin >= TCACHE_BINS) {
+        return 0;
+    }
+    tcache_t *tc = tcache_get();
+    if (tc->counts[bin] == TCACHE_COUNT) {
+        return 0;
+    }
+    *(void **)ptr = tc->bins[bin];
+    tc->bins[bin] = ptr;
+    tc->counts[bin]++;
+    return 1;
 }
 
-/* coalesce: merge two free blocks if they are next to each other
-arguments: b: the block to coalesce with its neighbors
+/* free_local: frees a block or slot of the calling thread's home arena,
+keeping it in the thread's cache if its bin has room
+arguments: a: the home arena, which owns ptr
+           ptr: the payload to free
+           usable: how many bytes the caller may use at ptr, or any smaller
+           number
 returns: nothing
 */
-void coalesce(block_t *b) {
-    if (!block_next_allocated(b)) {  // checks if the next block is free
-        long size = block_size(b);
-        block_t *next = block_next(b);
-        pull_free_block(next);  // pulls next block from free list
-        block_set_size_and_allocated(b, block_size(next) + size,
-                                     0);  // resets size of current block
+static void free_local(arena_t *a, void *ptr, long usable) {
+    if (tcache_put(ptr, usable)) {
+        return;
     }
-    if (!block_prev_allocated(b) ||
-        block_prev(b) ==
-            b) {  // checks if prev block is free or if b is first block in heap
-        long size = block_size(b);
-        block_t *prev = block_prev(b);
-        pull_free_block(prev);  // pulls prev from free list
-        block_set_size_and_allocated(prev, block_size(prev) + size,
-                                     0);  // resets size of prev
-        b = prev;                         // sets pointer
-        block_set_allocated(b, 0);
+    arena_lock(a);
+    heap_free(ptr);
+    arena_unlock(a);
+}
+
+/* realloc_mapped: resizes a large object that has a mapping of its own.
+Blocks in an arena stay there when they grow past MMAP_THRESHOLD, since they
+can often grow in place; only mm_malloc hands out new mappings.
+arguments: ptr: a pointer to the large object's payload
+           size: the desired new payload size
+returns: a pointer to the new payload, or NULL if an error occurred
+*/
+static void *realloc_mapped(void *ptr, long size) {
+    if (size >= MMAP_THRESHOLD) {  // stays mapped
+        return map_realloc(ptr, size);
     }
-    insert_free_block(b);
+    if (size == 0) {
+        map_free(ptr);
+        return NULL;
+    }
+    void *new_ptr = mm_malloc(size);  // size is less than the old size
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, size);
+    map_free(ptr);
+    return new_ptr;
+}
+
+/*
+ *                             _       _ _
+ *     _ __ ___  _ __ ___     (_)_ __ (_) |_
+ *    | '_ ` _ \| '_ ` _ \    | | '_ \| | __|
+ *    | | | | | | | | | | |   | | | | | | |_
+ *    |_| |_| |_|_| |_| |_|___|_|_| |_|_|\__|
+ *                       |_____|
+ *
+ * initializes the dynamic storage allocator (allocate initial heap space)
+ * arguments: none
+ * returns: 0, if successful
+ *         -1, if an error occurs
+ */
+int mm_init(void) {
+    pthread_once(&arenas_once, arenas_setup);
+    heap_generation++;  // every arena sets its heap up again on next use
+    if (arena_lock(&arenas[0]) < 0) {
+        return -1;
+    }
+    arena_unlock(&arenas[0]);
+    return 0;
 }
 
 /*     _ __ ___  _ __ ___      _ __ ___   __ _| | | ___   ___
@@ -119,60 +1701,27 @@ void coalesce(block_t *b) {
  *          is a multiple of ALIGNMENT), or NULL if an error occurred
  */
 void *mm_malloc(long size) {
-    if (size == 0) {
-        return NULL;
+    if (size >= MMAP_THRESHOLD) {  // large objects bypass the arenas
+        return map_alloc(size);
     }
-    size = align(size) + TAGS_SIZE;  // aligns and adds header and footer
-    block_t *new_block;
-
-    if (flist_first != NULL) {
-        block_t *cur = block_flink(flist_first);
-        do {
-            if (block_size(cur) - size >=
-                MINBLOCKSIZE) {  // checks if free block is big enough to split
-                new_block = NULL;
-                new_block = split(new_block, cur, size);  // splits free block
-                return new_block->payload;
-            } else if (size <=
-                       block_size(
-                           cur)) {  // checks if free block is bigger than size,
-                                    // but not big enough to split
-                pull_free_block(cur);
-                block_set_allocated(cur, 1);
-                return cur->payload;
-            }
-            cur = block_flink(cur);  // go to next free block in free list
-        } while (cur != flist_first);
-    }
-    int sbrk = 512;
-    if (size > 512) {
-        sbrk = size;
+    if (size > 0 && size <= TCACHE_MAX_SIZE) {  // try the thread's cache
+        tcache_t *tc = tcache_get();
+        int bin = (size - 1) / TCACHE_BIN_SIZE;
+        void *ptr = tc->bins[bin];
+        if (ptr != NULL) {
+            tc->bins[bin] = *(void **)ptr;
+            tc->counts[bin]--;
+            return ptr;
+        }
     }
-    block_t *holder =
-        mem_sbrk(sbrk);  // allocates enough space of size or 512 bytes
-
-    if (holder == (void *)-1) {  // error checks mem_sbrk
+    arena_t *a = thread_arena();
+    if (arena_lock(a) < 0) {
         return NULL;
     }
-
-    block_t *old_epilogue = epilogue;
-    block_set_size_and_allocated(old_epilogue, sbrk,
-                                 1);  // sets size and allocated of old_epilogue
-                                      // which is entire size of new block
-    epilogue = block_next(old_epilogue);  // sets new pointer of epilogue
-    block_set_size_and_allocated(epilogue, TAGS_SIZE,
-                                 1);  // sets size and allocated of epilogue
-
-    if (sbrk - size >= MINBLOCKSIZE) {  // check if we can split
-        block_set_size_and_allocated(old_epilogue, sbrk - size, 0);
-        insert_free_block(old_epilogue);
-        block_t *start_old = block_next(old_epilogue);  // new allocated block
-        block_set_size_and_allocated(start_old, size, 1);
-        return start_old->payload;
-    } else {  // no splitting
-        block_set_allocated(old_epilogue, 1);
-        return old_epilogue->payload;
-    }
+    drain_remote_frees();
+    void *ret = heap_malloc(size);
+    arena_unlock(a);
+    return ret;
 }
 
 /*                              __
@@ -190,18 +1739,16 @@ void mm_free(void *ptr) {
     if (ptr == NULL) {
         return;
     }
-    block_t *my_block = payload_to_block(ptr);
-
-    if (block_prev_allocated(my_block) &&
-        block_next_allocated(
-            my_block)) {  // checks if prev and next are allocated
-        block_set_allocated(my_block, 0);
-        insert_free_block(my_block);
-    } else {  // else coalesce
-        block_set_allocated(my_block, 0);
-        coalesce(my_block);
+    arena_t *a = arena_of(ptr);
+    if (a == NULL) {  // a large object's mapping goes straight back
+        map_free(ptr);
         return;
     }
+    if (a != home_arena) {  // the owning arena frees it on its next malloc
+        remote_free(a, ptr);
+        return;
+    }
+    free_local(a, ptr, usable_size(a, ptr));
 }
 
 /*
@@ -222,90 +1769,369 @@ void *mm_realloc(void *ptr, long size) {
     if (ptr == NULL) {
         return mm_malloc(size);
     }
-    if (size == 0) {
-        mm_free(ptr);
+    arena_t *a = arena_of(ptr);
+    if (a == NULL) {  // ptr has a mapping of its own
+        return realloc_mapped(ptr, size);
+    }
+    long usable = usable_size(a, ptr);
+    if (size > 0 && size <= usable) {
+        // a slot already fits, and so does a block unless enough of it is
+        // left over to split off. The lock is only needed to note that ptr
+        // has stopped growing (and to count it).
+        if (in_run(a, ptr) || usable - align(size) < MINBLOCKSIZE) {
+            if (arena_lock(a) < 0) {
+                return NULL;
+            }
+            note_growth(ptr, ptr, 0);
+            STAT(realloc_in_place, 1);
+            arena_unlock(a);
+            return ptr;
+        }
+    } else if (size > usable) {
+        // blocks held in the cache could be the neighbors ptr needs to grow
+        // into, or the free block it moves to
+        tcache_flush(tcache_get());
+    }
+    // a block is resized in the arena that owns it
+    if (arena_lock(a) < 0) {
         return NULL;
     }
+    int grew = size > usable;
+    void *ret = heap_realloc(ptr, size);
+    note_growth(ptr, ret, grew);
+    arena_unlock(a);
+    return ret;
+}
 
-    block_t *cur = payload_to_block(ptr);
-    long cur_b_size = block_size(cur);
-    long nsize = align(size) + TAGS_SIZE;
-    if (nsize <= cur_b_size) {  // checks if we are decreasing size
-        if (cur_b_size - nsize >= MINBLOCKSIZE) {  // check if we can split
-            block_set_size(cur, nsize);
-            block_set_size_and_allocated(block_next(cur), cur_b_size - nsize,
-                                         0);
-            insert_free_block(block_next(cur));
-        }
-        return cur->payload;
+/*
+ *                                      _ _
+ *     _ __ ___  _ __ ___      ___ __ _| | | ___   ___
+ *    | '_ ` _ \| '_ ` _ \    / __/ _` | | |/ _ \ / __|
+ *    | | | | | | | | | | |  | (_| (_| | | | (_) | (__
+ *    |_| |_| |_|_| |_| |_|___\___\__,_|_|_|\___/ \___|
+ *                       |_____|
+ *
+ * allocates zero-filled memory for an array
+ * arguments: nmemb: the number of elements
+ *            size: the size of each element
+ * returns: a pointer to the zeroed payload, or NULL if an error occurred or
+ *          nmemb * size overflows
+ * NOTE: large objects get a fresh mapping, and blocks carved from memory the
+ * heap knows to be zero only need their link words and old end tag cleared,
+ * so the memset is skipped for most of their payload
+ */
+void *mm_calloc(long nmemb, long size) {
+    if (nmemb < 0 || size < 0 || (size != 0 && nmemb > LONG_MAX / size)) {
+        return NULL;
+    }
+    long bytes = nmemb * size;
+    if (bytes >= MMAP_THRESHOLD) {  // fresh mappings are already zero
+        return map_alloc(bytes);
+    }
+    // the thread's cache is skipped, since its blocks are never zero
+    arena_t *a = thread_arena();
+    if (arena_lock(a) < 0) {
+        return NULL;
+    }
+    drain_remote_frees();
+    int zeroed;
+    long *ret = heap_alloc(bytes, &zeroed);
+    long usable = ret == NULL ? 0 : usable_size(a, ret);
+    arena_unlock(a);
+    if (ret == NULL) {
+        return NULL;
+    }
+    if (!zeroed) {
+        memset(ret, 0, bytes);
+        return ret;
+    }
+    // only the free block's links and end tag can be nonzero
+    long words = usable / WORD_SIZE;
+    for (long i = 0; i < FREE_LINK_WORDS && i < words; i++) {
+        ret[i] = 0;
+    }
+    ret[words - 1] = 0;
+    return ret;
+}
 
-    } else {                               // nsize is bigger than current size
-        if (!block_next_allocated(cur)) {  // checks if next block is free
-            long tot_size = block_next_size(cur) + cur_b_size;
-            long diff = tot_size - nsize;
-            if (diff >= 0) {  // checks if next block has enough space
-                if (diff >= MINBLOCKSIZE) {  // check if we can split
-                    pull_free_block(block_next(cur));
-                    block_set_size_and_allocated(cur, nsize, 1);
-                    block_set_size_and_allocated(block_next(cur), diff, 0);
-                    insert_free_block(block_next(cur));
-                } else {  // if we can't split
-                    pull_free_block(block_next(cur));
-                    block_set_size(cur, tot_size);
-                }
-                return cur->payload;
+/*
+ *                                                            _ _
+ *     _ __ ___  _ __ ___      _ __ ___   ___ _ __ ___   __ _| (_) __ _ _ __
+ *    | '_ ` _ \| '_ ` _ \    | '_ ` _ \ / _ \ '_ ` _ \ / _` | | |/ _` | '_ \
+ *    | | | | | | | | | | |   | | | | | |  __/ | | | | | (_| | | | (_| | | | |
+ *    |_| |_| |_|_| |_| |_|___|_| |_| |_|\___|_| |_| |_|\__,_|_|_|\__, |_| |_|
+ *                       |_____|                                  |___/
+ *
+ * allocates memory whose payload is aligned to a given boundary, such as a
+ * cache line or a page
+ * arguments: alignment: the required alignment, a power of two
+ *            size: the desired payload size
+ * returns: a pointer to the aligned payload, or NULL if an error occurred,
+ *          alignment is not a power of two, or the block could not fit in
+ *          a region
+ * NOTE: the block is carved out of a free block that holds an aligned payload
+ * somewhere inside it, and the space before it is split off as a free block
+ * of its own rather than wasted
+ */
+void *mm_memalign(long alignment, long size) {
+    if (alignment <= 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {  // every payload is aligned this much
+        return mm_malloc(size);
+    }
+    if (size <= 0) {
+        return NULL;
+    }
+    if (alignment > MAX_HEAP || size > MAX_HEAP) {  // no region could hold it
+        return NULL;
+    }
+    // aligned blocks always come from the heap, even large ones, since a
+    // mapping's payload sits just past its page boundary
+    long bsize = align(size) + ALLOC_TAGS_SIZE;
+    if (bsize < MINBLOCKSIZE) {
+        bsize = MINBLOCKSIZE;
+    }
+    arena_t *a = thread_arena();
+    if (arena_lock(a) < 0) {
+        return NULL;
+    }
+    drain_remote_frees();
+    block_t *b = alloc_aligned_block(bsize, alignment);
+    arena_unlock(a);
+    return b == NULL ? NULL : b->payload;
+}
+
+/*
+ *                              __                       _              _
+ *     _ __ ___  _ __ ___      / _|_ __ ___  ___     ___(_)________  __| |
+ *    | '_ ` _ \| '_ ` _ \    | |_| '__/ _ \/ _ \   / __| |_  // _ \/ _` |
+ *    | | | | | | | | | | |   |  _| | |  __/  __/   \__ \ |/ /|  __/ (_| |
+ *    |_| |_| |_|_| |_| |_|___|_| |_|  \___|\___|___|___/_/___|\___|\__,_|
+ *                       |_____|               |_____|
+ *
+ * frees a block of memory whose size the caller already knows
+ * arguments: ptr: pointer to the block's payload
+ *            size: the size ptr was allocated with (or any size up to
+ *            mm_usable_size(ptr))
+ * returns: nothing
+ * NOTE: the size picks the thread cache bin directly, so a block that goes
+ * into the cache never has its header (or its run's header, for a slot) read.
+ * Only that path is faster: when the bin is full, the block is freed to the
+ * heap as mm_free would, which reads its header and its neighbors' anyway
+ */
+void mm_free_sized(void *ptr, long size) {
+    if (ptr == NULL) {
+        return;
+    }
+    arena_t *a = arena_of(ptr);
+    if (a == NULL) {  // a large object's mapping goes straight back
+        map_free(ptr);
+        return;
+    }
+    if (a != home_arena) {  // the owning arena frees it on its next malloc
+        remote_free(a, ptr);
+        return;
+    }
+    free_local(a, ptr, size);
+}
+
+/*
+ *                                            _     _              _
+ *     _ __ ___  _ __ ___     _   _ ___  __ _| |__ | | ___     ___(_)________
+ *    | '_ ` _ \| '_ ` _ \   | | | / __|/ _` | '_ \| |/ _ \   / __| |_  // _ \
+ *    | | | | | | | | | | |  | |_| \__ \ (_| | |_) | |  __/   \__ \ |/ /|  __/
+ *    |_| |_| |_|_| |_| |_|___\__,_|___/\__,_|_.__/|_|\___|___|___/_/___|\___|
+ *                       |_____|                         |_____|
+ *
+ * finds how many bytes a block really holds, which may be more than was
+ * asked for
+ * arguments: ptr: a pointer returned by the allocator, or NULL
+ * returns: the number of payload bytes the caller may use at ptr, or 0 if
+ *          ptr is NULL
+ * NOTE: growing into this slack needs no call to mm_realloc
+ */
+long mm_usable_size(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    arena_t *a = arena_of(ptr);
+    if (a == NULL) {  // the header of a mapping covers the whole mapping
+        return block_size(payload_to_block(ptr)) - ALLOC_TAGS_SIZE;
+    }
+    return usable_size(a, ptr);
+}
+
+/*
+ *                                             _ _
+ *     _ __ ___  _ __ ___      _ __ ___   __ _| | | ___   ___
+ *    | '_ ` _ \| '_ ` _ \    | '_ ` _ \ / _` | | |/ _ \ / __|
+ *    | | | | | | | | | | |   | | | | | | (_| | | | (_) | (__
+ *    |_| |_| |_|_| |_| |_|___|_| |_| |_|\__,_|_|_|\___/ \___|____
+ *                       |_____|                            |_____|
+ *     _           _       _
+ *    | |__   __ _| |_ ___| |__
+ *    | '_ \ / _` | __/ __| '_ \
+ *    | |_) | (_| | || (__| | | |
+ *    |_.__/ \__,_|\__\___|_| |_|
+ *
+ * allocates several blocks of the same size in one call
+ * arguments: size: the desired payload size of each block
+ *            n: how many blocks to allocate
+ *            out: an array of n pointers, filled with the payloads
+ * returns: how many blocks were allocated; if fewer than n, the heap ran out
+ *          of memory and only out[0] to out[returned - 1] are valid
+ * NOTE: the blocks are carved side by side out of a single free block (or a
+ * single heap extension) under one lock, and out lists them in address order
+ */
+long mm_malloc_batch(long size, long n, void **out) {
+    if (size <= 0 || n <= 0) {
+        return 0;
+    }
+    if (n == 1) {  // a lone block may as well come from the thread's cache
+        out[0] = mm_malloc(size);
+        return out[0] != NULL;
+    }
+    if (size >= MMAP_THRESHOLD) {  // large objects bypass the arenas
+        for (long i = 0; i < n; i++) {
+            if ((out[i] = map_alloc(size)) == NULL) {
+                return i;
             }
         }
+        return n;
+    }
+    arena_t *a = thread_arena();
+    if (arena_lock(a) < 0) {
+        return 0;
+    }
+    drain_remote_frees();
+    long ret = heap_malloc_batch(size, n, out);
+    arena_unlock(a);
+    return ret;
+}
 
-        if (!block_prev_allocated(cur)) {  // checks if prev is free
-            long tot_size = block_size(block_prev(cur)) + cur_b_size;
-            long diff = tot_size - nsize;
-            void *ret;
-            if (diff >= 0) {                 // check if prev has enough space
-                if (diff >= MINBLOCKSIZE) {  // check if we can split
-                    block_t *prev = block_prev(cur);
-                    block_set_size_and_allocated(prev, diff, 0);
-                    block_set_size_and_allocated(block_next(prev), nsize, 1);
-                    ret = memmove((char *)(prev->payload) + diff, ptr,
-                                  cur_b_size - TAGS_SIZE);
-                } else {  // if we can't split
-                    pull_free_block(block_prev(cur));
-                    block_set_size_and_allocated(block_prev(cur), tot_size, 1);
-                    ret = memmove(block_prev(cur)->payload, ptr,
-                                  cur_b_size - TAGS_SIZE);
-                }
-                return ret;
+/*
+ *                              __                   _           _       _
+ *     _ __ ___  _ __ ___      / _|_ __ ___  ___    | |__   __ _| |_ ___| |__
+ *    | '_ ` _ \| '_ ` _ \    | |_| '__/ _ \/ _ \   | '_ \ / _` | __/ __| '_ \
+ *    | | | | | | | | | | |   |  _| | |  __/  __/   | |_) | (_| | || (__| | | |
+ *    |_| |_| |_|_| |_| |_|___|_| |_|  \___|\___|___|_.__/ \__,_|\__\___|_| |_|
+ *                       |_____|               |_____|
+ *
+ * frees several blocks of memory in one call
+ * arguments: ptrs: the payloads to free; NULL entries are skipped
+ *            n: how many entries ptrs has
+ * returns: nothing
+ * NOTE: the thread's own blocks are sized and freed under one lock, and
+ * blocks that follow each other in memory (such as a batch from
+ * mm_malloc_batch, freed in the same order) are coalesced once as a whole
+ * rather than one by one
+ */
+void mm_free_batch(void **ptrs, long n) {
+    int locked = 0;
+    long start = 0;     // ptrs[start] to ptrs[i - 1] are left for the arena
+    int prev_home = 0;  // whether ptrs[i - 1] belongs to the home arena
+    for (long i = 0; i <= n; i++) {
+        arena_t *a = NULL;
+        if (i < n && ptrs[i] != NULL) {
+            a = arena_of(ptrs[i]);
+        }
+        int home = a != NULL && a == home_arena;
+        if (home) {
+            if (!locked) {  // neighbors' headers only hold still under the lock
+                arena_lock(home_arena);
+                locked = 1;
+            }
+            // only a block with no neighbor in ptrs may go in the cache
+            int next_home =
+                i + 1 < n && ptrs[i + 1] != NULL && arena_of(ptrs[i + 1]) == a;
+            if ((prev_home && adjacent(a, ptrs[i - 1], ptrs[i])) ||
+                (next_home && adjacent(a, ptrs[i], ptrs[i + 1])) ||
+                !tcache_put(ptrs[i], usable_size(a, ptrs[i]))) {
+                prev_home = 1;
+                continue;
             }
         }
-        if (!block_next_allocated(cur) &&
-            !block_prev_allocated(cur)) {  // check if next and prev and free
-            long tot_size =
-                block_next_size(cur) + block_prev_size(cur) + cur_b_size;
-            long diff = tot_size - nsize;
-            void *ret;
-            if (diff >= 0) {  // checks if next and prev have enough space
-                if (diff >= MINBLOCKSIZE) {  // check if we can split
-                    pull_free_block(block_next(cur));
-                    block_t *prev = block_prev(cur);
-                    block_set_size_and_allocated(prev, diff, 0);
-                    block_set_size_and_allocated(block_next(prev), nsize, 1);
-                    ret = memmove((char *)(prev->payload) + diff, ptr,
-                                  cur_b_size - TAGS_SIZE);
-                } else {  // if we can't split
-                    pull_free_block(block_next(cur));
-                    block_set_size_and_allocated(block_prev(cur), tot_size, 1);
-                    ret = memmove(block_prev(cur)->payload, ptr,
-                                  cur_b_size - TAGS_SIZE);
-                }
-                return ret;
+        prev_home = home;
+        if (i > start) {  // the lock was taken at ptrs[start]
+            heap_free_batch(&ptrs[start], i - start);
+        }
+        start = i + 1;
+        if (a == NULL) {
+            if (i < n && ptrs[i] != NULL) {  // a large object's mapping
+                map_free(ptrs[i]);
             }
+        } else if (!home) {  // the owning arena frees it on its next malloc
+#if !REMOTE_QUEUE
+            if (locked) {  // never holds two arenas' locks at once
+                arena_unlock(home_arena);
+                locked = 0;
+            }
+#endif
+            remote_free(a, ptrs[i]);
         }
-        block_t *new_block = mm_malloc(nsize);
-        if (new_block == NULL) {  // error check malloc
-            return NULL;
+    }
+    if (locked) {
+        arena_unlock(home_arena);
+    }
+}
+
+/*
+ *                                        _           _        _
+ *     _ __ ___  _ __ ___       __ _  ___| |_     ___| |_ __ _| |_ ___
+ *    | '_ ` _ \| '_ ` _ \     / _` |/ _ \ __|   / __| __/ _` | __/ __|
+ *    | | | | | | | | | | |   | (_| |  __/ |_    \__ \ || (_| | |_\__ \
+ *    |_| |_| |_|_| |_| |_|____\__, |\___|\__|___|___/\__\__,_|\__|___/
+ *                       |_____|___/        |_____|
+ *
+ * sums up the counters every arena has kept since the last mm_init
+ * arguments: stats: where to store the sums
+ * returns: 0, if successful
+ *          -1, if mm.c was built without MM_STATS (stats is left alone)
+ */
+int mm_get_stats(mm_stats_t *stats) {
+#if MM_STATS
+    pthread_once(&arenas_once, arenas_setup);
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < NUM_ARENAS; i++) {
+        pthread_mutex_lock(&arenas[i].lock);
+        if (arenas[i].generation == heap_generation) {  // counted this heap
+            long *sum = (long *)stats;
+            long *count = (long *)&arenas[i].stats;
+            for (unsigned long j = 0; j < sizeof(*stats) / sizeof(long); j++) {
+                sum[j] += count[j];
+            }
         }
-        new_block = memmove(new_block, ptr, align(size));
-        mm_free(ptr);
-        return new_block;
+        pthread_mutex_unlock(&arenas[i].lock);
     }
-}
\ No newline at end of file
+    return 0;
+#else
+    (void)stats;
+    return -1;
+#endif
+}
+
+/*
+ *                                                     _   _
+ *     _ __ ___  _ __ ___       __ _ _ __ _____      _| |_| |__
+ *    | '_ ` _ \| '_ ` _ \     / _` | '__/ _ \ \ /\ / / __| '_ \
+ *    | | | | | | | | | | |   | (_| | | | (_) \ V  V /| |_| | | |
+ *    |_| |_| |_|_| |_| |_|____\__, |_|  \___/ \_/\_/  \__|_| |_|
+ *                       |_____|___/
+ *
+ * reports the heap growth policy mm.c was built with, so that a change in
+ * utilization can be traced back to it
+ * arguments: none
+ * returns: the policy's parameters
+ */
+mm_growth_t mm_growth(void) {
+    mm_growth_t growth;
+
+    growth.adaptive = ADAPTIVE_GROWTH;
+    growth.min = GROW_MIN;
+    growth.max = ADAPTIVE_GROWTH ? GROW_MAX : GROW_MIN;
+    growth.burst = GROW_BURST;
+    growth.quiet = GROW_QUIET;
+    growth.trim = TRIM_THRESHOLD;
+    return growth;
+}
@@ -7,6 +7,12 @@ int mm_init(void);
 void *mm_malloc(long size);
 void mm_free(void *ptr);
 void *mm_realloc(void *ptr, long size);
+void *mm_calloc(long nmemb, long size);
+void *mm_memalign(long alignment, long size);
+void mm_free_sized(void *ptr, long size);
+long mm_usable_size(void *ptr);
+long mm_malloc_batch(long size, long n, void **out);
+void mm_free_batch(void **ptrs, long n);
 
 // Defines alignment to 8 bytes.
 #define ALIGNMENT 8
@@ -16,23 +22,69 @@ void *mm_realloc(void *ptr, long size);
 // Sum of the sizes of the beginning and end tags of a block.
 // (Each tag's size is WORD_SIZE)
 #define TAGS_SIZE (long)(2 * WORD_SIZE)
+// Allocated blocks only keep their beginning tag, so this is all the space
+// an allocated block loses to tags.
+#define ALLOC_TAGS_SIZE (long)(WORD_SIZE)
 // Minimum size of a block. Your implementation should make
 // sure no allocated or free block has a size of less than
-// this constant.
-#define MINBLOCKSIZE (long)(4 * WORD_SIZE)
+// this constant. A free block of this size is just its header and one word
+// that holds both its blink and its end tag.
+#define MINBLOCKSIZE (long)(2 * WORD_SIZE)
 
 typedef struct block {
-    long size;
-    // size is assumed to be a multiple of 8. The least-significant bit is
-    // overloaded:
-    //     if 0 the block is free
-    //     if 1 the block is allocated
+    unsigned int size;
+    // size is assumed to be a multiple of 8. The three least-significant bits
+    // are overloaded:
+    //     bit 0 is 1 if the block is allocated, 0 if it is free
+    //     bit 1 is 1 if the previous block is allocated, 0 if it is free
+    //     bit 2 is 1 if the block is free and known to be zero
+    int flink;
+    // for free blocks in a free list, the offset of the block's flink (the
+    // next block in the free list) from the start of the arena's region
     long payload[];
     // the actual size of payload is given in the size field
     // for free blocks:
-    //     payload[0] is the block's flink (the next block in the free list)
-    //     payload[1] is the block's blink (the previous block in the free list)
-    // there is a copy of the size field at the end of the block
+    //     the high half of payload[0] is the offset of the block's blink (the
+    //     previous block in the free list)
+    //     the low half of the last word is a copy of the size field (the end
+    //     tag); in a MINBLOCKSIZE block this is the low half of payload[0]
+    // allocated blocks have no copy at the end; their payload runs all the
+    // way to the next block's size field
 } block_t;
 
+// Counters mm.c keeps when it is built with -D MM_STATS=1, summed over every
+// arena since the last mm_init (see mm_get_stats)
+#define MM_PROBE_BUCKETS 8
+typedef struct mm_stats {
+    // mallocs served by a search of the heap's free blocks, by how many free
+    // blocks the search probed: 1, 2, 3-4, 5-8, 9-16, 17-32, 33-64 and more
+    // than 64 (quick-list hits and searches that found nothing are left out)
+    long probe_hist[MM_PROBE_BUCKETS];
+    long splits;  // free blocks split to allocate part of them
+    // frees merged with only the block before, only the block after, or
+    // both (merges when the heap grows or a block shrinks are left out)
+    long coalesce_prev;
+    long coalesce_next;
+    long coalesce_both;
+    long sbrks;             // heap extensions
+    long sbrk_bytes;        // bytes the heap grew by
+    long realloc_in_place;  // reallocs that kept their address
+    long realloc_moved;     // reallocs that copied the payload elsewhere
+    long moved_bytes;       // bytes those reallocs copied
+} mm_stats_t;
+
+int mm_get_stats(mm_stats_t *stats);
+
+// The heap growth policy mm.c was built with (see mm_growth)
+typedef struct mm_growth {
+    int adaptive;  // 1 if the chunk adapts to how often the heap grows
+    long min;      // the smallest chunk, and the only one if not adaptive
+    long max;      // the largest chunk
+    long burst;    // growing again within this many mallocs doubles the chunk
+    long quiet;    // going this many mallocs without growing halves it
+    long trim;     // a free block this big at the top of the heap is trimmed
+} mm_growth_t;
+
+mm_growth_t mm_growth(void);
+
 #endif  // MM_H_
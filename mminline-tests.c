@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #include "mminline.h"
 #include "mm.h"
 #include "./memlib.h"
+#include "./config.h"
 
 #define USAGE                                                            \
     "./inline_tests <all | "                                                \
@@ -14,7 +16,11 @@
     "\n   Ex. \"./inline_tests all\" runs all tests"                        \
     "\n   Ex. \"./inline_tests set_flink set_blink\" runs the set_flink and set_blink " \
     "\n   Ex. \"./inline_tests pull_free_block\" runs the pull_free_block test" \
-    "\n   Possible tests: 'set_flink', 'set_blink', 'pull_free_block'"
+    "\n   Possible tests: 'set_flink', 'set_blink', 'pull_free_block', "   \
+    "'malloc_batch', 'calloc', 'memalign', 'quick_lists', 'slab', "       \
+    "'mapped', 'placement', "                                             \
+    "'skip_list' (ADDRESS_ORDERED=1 builds), 'size_index' (SIZE_INDEX=1 "  \
+    "builds)"
 
 void assert_flink(block_t *expected, block_t *actual, const char *message);
 
@@ -24,9 +30,13 @@ void assert_pull_free_block(block_t *expected, block_t *actual, const char *mess
 
 void print_test_summary();
 
-static block_t *flist_first;
 block_t* prologue;
 block_t* epilogue;
+// the free lists, bitmaps and tree the helpers under test work on
+static free_index_t test_index;
+
+// size class shared by the 256..287 byte blocks used in the free list tests
+#define TEST_CLASS (4 * SL_COUNT)
 
 
 void set_size_test(){
@@ -97,16 +107,24 @@ void end_tag_test(){
     epilogue = malloc(16);
     block_t *block1 = (block_t *)malloc(8*2 + 32);
     block_t *block2 = (block_t *)malloc(8*2 + 64);
-    block_set_size_and_allocated(block1, 32, 1);
+    block_set_size_and_allocated(block1, 32, 0);
     block_set_size_and_allocated(block2, 64, 0);
 
     sleep(1);
 
+    // only free blocks carry an end tag
     assert(block_size(block1) == block_end_size(block1));
     assert(block_size(block2) == block_end_size(block2));
-    assert(block_end_allocated(block1)==1);
+    assert(block_end_allocated(block1)==0);
     assert(block_end_allocated(block2)==0);
 
+    // allocating a block leaves the last word of its payload alone
+    *block_end_tag(block1) = 0x55;
+    block_set_allocated(block1, 1);
+    assert(*block_end_tag(block1) == 0x55);
+    block_set_size(block1, 32);
+    assert(*block_end_tag(block1) == 0x55);
+
     free(prologue);
     free(epilogue);
     free(block1);
@@ -119,9 +137,11 @@ void prev_test(){
     block_t *block2 = mem_sbrk(96);
     block_t *block3 = mem_sbrk(128);
 
-    block_set_size_and_allocated(block1, 96, 1);
+    block_set_size_and_allocated(block1, 96, 0);
     block_set_size_and_allocated(block2, 96, 0);
     block_set_size_and_allocated(block3, 128, 0);
+    block_set_prev_allocated(block2, 0);
+    block_set_prev_allocated(block3, 0);
     
     assert(((long)block_prev(block2)) == (long)block1);
     assert(((long)block_prev(block3)) == (long)block2);
@@ -176,11 +196,22 @@ void prev_size_allocated_test(){
     block_set_size_and_allocated(block1, 64, 1);
     block_set_size_and_allocated(block2, 96, 0);
     block_set_size_and_allocated(block3, 128, 1);
+    block_set_prev_allocated(block2, 1);
+    block_set_prev_allocated(block3, 0);
     
     assert(block_prev_allocated(block3) == 0);
     assert(block_prev_allocated(block2) == 1);
     assert(block_prev_size(block3) == 96);
-    assert(block_prev_size(block2) == 64);
+
+    // the prev-allocated bit is independent of the block's own size and
+    // allocated bit
+    block_set_size_and_allocated(block3, 128, 0);
+    assert(block_prev_allocated(block3) == 0);
+    block_set_prev_allocated(block3, 1);
+    assert(block_prev_allocated(block3) == 1);
+    assert(block_size(block3) == 128);
+    assert(!block_allocated(block3));
+    assert(block_end_size(block3) == 128);
 
     mem_deinit();
 }
@@ -245,37 +276,139 @@ void set_blink_test() {
     free(new_blink);
 }
 
+void size_class_test() {
+    assert(size_class(MINBLOCKSIZE) == 0);
+    assert(size_class(24) == 4);
+    assert(size_class(40) == SL_COUNT + 2);
+    assert(size_class(64) == 2 * SL_COUNT);
+    assert(size_class(72) == 2 * SL_COUNT + 1);
+    assert(size_class(256) == TEST_CLASS);
+    assert(size_class(280) == TEST_CLASS);
+    assert(size_class(288) == TEST_CLASS + 1);
+    assert(size_class(1L << 40) == NUM_SIZE_CLASSES - 1);
+}
+
+void next_free_class_test() {
+    prologue = malloc(16);
+    epilogue = malloc(16);
+    block_t *block1 = (block_t *)malloc(8*2 + 256);
+    block_t *block2 = (block_t *)malloc(8*2 + 512);
+    findex->fl_bitmap = 0;
+    memset(findex->sl_bitmap, 0, sizeof(findex->sl_bitmap));
+    memset(findex->flist_first, 0, sizeof(findex->flist_first));
+    block_set_size_and_allocated(block1, 256, 0);
+    block_set_size_and_allocated(block2, 512, 0);
+
+    assert(next_free_class(0) == -1);
+    insert_free_block(block1);
+    insert_free_block(block2);
+    assert(next_free_class(0) == TEST_CLASS);
+    assert(next_free_class(TEST_CLASS) == TEST_CLASS);
+    assert(next_free_class(TEST_CLASS + 1) == size_class(512));
+    pull_free_block(block1);
+    assert(next_free_class(0) == size_class(512));
+    pull_free_block(block2);
+    assert(next_free_class(0) == -1);
+    assert(findex->fl_bitmap == 0);
+
+    free(prologue);
+    free(epilogue);
+    free(block1);
+    free(block2);
+}
+
+// checks the ordering and priority invariants of the subtree rooted at b and
+// returns the number of blocks in it
+int check_tree(block_t *b, block_t *parent) {
+    if (b == NULL) {
+        return 0;
+    }
+    assert(tree_parent(b) == parent);
+    if (tree_left(b) != NULL) {
+        assert(tree_before(tree_left(b), b));
+        assert(tree_priority(tree_left(b)) <= tree_priority(b));
+    }
+    if (tree_right(b) != NULL) {
+        assert(tree_before(b, tree_right(b)));
+        assert(tree_priority(tree_right(b)) <= tree_priority(b));
+    }
+    return 1 + check_tree(tree_left(b), b) + check_tree(tree_right(b), b);
+}
+
+void tree_test() {
+    long sizes[] = {2048, 1024, 4096, 2048, 1536, 8192, 1024};
+    int n = sizeof(sizes) / sizeof(sizes[0]);
+    block_t *blocks[sizeof(sizes) / sizeof(sizes[0])];
+    findex->ftree_root = NULL;
+    for (int i = 0; i < n; i++) {
+        blocks[i] = (block_t *)malloc(8*2 + sizes[i]);
+        block_set_size_and_allocated(blocks[i], sizes[i], 0);
+        insert_free_block(blocks[i]);
+        assert(check_tree(findex->ftree_root, NULL) == i + 1);
+    }
+
+    // best fit picks the smallest block that fits, lowest address on ties
+    block_t *low_1024 = blocks[1] < blocks[6] ? blocks[1] : blocks[6];
+    block_t *low_2048 = blocks[0] < blocks[3] ? blocks[0] : blocks[3];
+    assert(tree_best_fit(1000) == low_1024);
+    assert(tree_best_fit(1024) == low_1024);
+    assert(tree_best_fit(1032) == blocks[4]);
+    assert(tree_best_fit(2000) == low_2048);
+    assert(tree_best_fit(8192) == blocks[5]);
+    assert(tree_best_fit(8200) == NULL);
+
+    pull_free_block(blocks[4]);
+    assert(check_tree(findex->ftree_root, NULL) == n - 1);
+    assert(tree_best_fit(1032) == low_2048);
+    pull_free_block(low_2048);
+    pull_free_block(blocks[5]);
+    assert(check_tree(findex->ftree_root, NULL) == n - 3);
+    assert(tree_best_fit(2000) == (low_2048 == blocks[0] ? blocks[3]
+                                                         : blocks[0]));
+    assert(tree_best_fit(4100) == NULL);
+
+    for (int i = 0; i < n; i++) {
+        if (i != 4 && i != 5 && blocks[i] != low_2048) {
+            pull_free_block(blocks[i]);
+        }
+    }
+    assert(findex->ftree_root == NULL);
+    for (int i = 0; i < n; i++) {
+        free(blocks[i]);
+    }
+}
+
 void insert_free_block_test() {
     prologue = malloc(16);
     epilogue = malloc(16);
-    block_t *block1 = (block_t *)malloc(8*2 + 32);
-    block_t *block2 = (block_t *)malloc(8*2 + 64);
-    block_t *block3 = (block_t *)malloc(8*2 + 48);
-    flist_first = NULL;
-    block_set_size_and_allocated(block1, 32, 0);
-    block_set_size_and_allocated(block2, 64, 0);
-    block_set_size_and_allocated(block3, 48, 0);
+    block_t *block1 = (block_t *)malloc(8*2 + 256);
+    block_t *block2 = (block_t *)malloc(8*2 + 264);
+    block_t *block3 = (block_t *)malloc(8*2 + 272);
+    findex->flist_first[TEST_CLASS] = NULL;
+    block_set_size_and_allocated(block1, 256, 0);
+    block_set_size_and_allocated(block2, 264, 0);
+    block_set_size_and_allocated(block3, 272, 0);
 
     insert_free_block(block1);
-    assert((block_t *)flist_first == (block_t *)block1);
-    assert((block_t *)block1->payload[0]==(block_t *)block1);
-    assert((block_t *)block1->payload[1]==(block_t *)block1);
+    assert((block_t *)findex->flist_first[TEST_CLASS] == (block_t *)block1);
+    assert(block_flink(block1)==(block_t *)block1);
+    assert(block_blink(block1)==(block_t *)block1);
 
     insert_free_block(block2);
-    assert((block_t *)flist_first == (block_t *)block2);
-    assert((block_t *)flist_first->payload[0]==(block_t *)block1);
-    assert((block_t *)flist_first->payload[1]==(block_t *)block1);
-    assert((block_t *)block1->payload[0]==(block_t *)flist_first);
-    assert((block_t *)block1->payload[1]==(block_t *)flist_first);
-    assert((block_t *)block2->payload[0]==(block_t *)block1);
-    assert((block_t *)block2->payload[1]==(block_t *)block1);
+    assert((block_t *)findex->flist_first[TEST_CLASS] == (block_t *)block2);
+    assert(block_flink(findex->flist_first[TEST_CLASS])==(block_t *)block1);
+    assert(block_blink(findex->flist_first[TEST_CLASS])==(block_t *)block1);
+    assert(block_flink(block1)==(block_t *)findex->flist_first[TEST_CLASS]);
+    assert(block_blink(block1)==(block_t *)findex->flist_first[TEST_CLASS]);
+    assert(block_flink(block2)==(block_t *)block1);
+    assert(block_blink(block2)==(block_t *)block1);
 
     insert_free_block(block3);
-    assert((block_t *)flist_first == (block_t *)block3);
-    assert((block_t *)block3->payload[0]==(block_t *)block2);
-    assert((block_t *)block3->payload[1]==(block_t *)block1);
-    assert((block_t *)block2->payload[1]==(block_t *)block3);
-    assert((block_t *)block1->payload[0]==(block_t *)block3);
+    assert((block_t *)findex->flist_first[TEST_CLASS] == (block_t *)block3);
+    assert(block_flink(block3)==(block_t *)block2);
+    assert(block_blink(block3)==(block_t *)block1);
+    assert(block_blink(block2)==(block_t *)block3);
+    assert(block_flink(block1)==(block_t *)block3);
 
     free(prologue);
     free(epilogue);
@@ -287,45 +420,45 @@ void insert_free_block_test() {
 void pull_free_block_test() {
     prologue = malloc(16);
     epilogue = malloc(16);
-    block_t *block_one = (block_t *)malloc(8*2 + 32);
-    block_t *block_two = (block_t *)malloc(8*2 + 64);
-    block_t *block_three = (block_t *)malloc(8*2 + 48);
-    flist_first = NULL;
-    block_set_size_and_allocated(block_one, 32, 0);
-    block_set_size_and_allocated(block_two, 64, 0);
-    block_set_size_and_allocated(block_three, 48, 0);
+    block_t *block_one = (block_t *)malloc(8*2 + 256);
+    block_t *block_two = (block_t *)malloc(8*2 + 264);
+    block_t *block_three = (block_t *)malloc(8*2 + 272);
+    findex->flist_first[TEST_CLASS] = NULL;
+    block_set_size_and_allocated(block_one, 256, 0);
+    block_set_size_and_allocated(block_two, 264, 0);
+    block_set_size_and_allocated(block_three, 272, 0);
     insert_free_block(block_three);
     insert_free_block(block_two);
     insert_free_block(block_one);
     pull_free_block(block_two);
     
     sleep(1);
-    assert(block_one->payload[0] == (long)((char *)block_three));
-    assert(block_one->payload[1] == (long)((char *)block_three));
-    assert(block_three->payload[0] == (long)((char *)block_one));
-    assert(block_three->payload[1] == (long)((char *)block_one));
-    assert(flist_first != NULL);
-    assert((block_t *)flist_first == (block_t *) block_one);
+    assert(block_flink(block_one) == block_three);
+    assert(block_blink(block_one) == block_three);
+    assert(block_flink(block_three) == block_one);
+    assert(block_blink(block_three) == block_one);
+    assert(findex->flist_first[TEST_CLASS] != NULL);
+    assert((block_t *)findex->flist_first[TEST_CLASS] == (block_t *) block_one);
     
     pull_free_block(block_three);
     sleep(1);
-    assert(block_one->payload[0] == (long)((char *)block_one));
-    assert(block_one->payload[1] == (long)((char *)block_one));
-    assert(flist_first != NULL);
-    assert((block_t *)flist_first == (block_t *) block_one);
+    assert(block_flink(block_one) == block_one);
+    assert(block_blink(block_one) == block_one);
+    assert(findex->flist_first[TEST_CLASS] != NULL);
+    assert((block_t *)findex->flist_first[TEST_CLASS] == (block_t *) block_one);
 
     pull_free_block(block_one);
     sleep(1);
-    assert(flist_first == NULL);
+    assert(findex->flist_first[TEST_CLASS] == NULL);
 
-    block_t *block_four = (block_t *)malloc(8*2 + 32);
-    block_t *block_five = (block_t *)malloc(8*2 + 64);
-    block_t *block_six = (block_t *)malloc(8*2 + 48);
-    block_t *block_seven = (block_t *)malloc(8*2 + 96);
-    block_set_size_and_allocated(block_four, 32, 0);
-    block_set_size_and_allocated(block_five, 64, 0);
-    block_set_size_and_allocated(block_six, 48, 0);
-    block_set_size_and_allocated(block_seven, 96, 0);
+    block_t *block_four = (block_t *)malloc(8*2 + 256);
+    block_t *block_five = (block_t *)malloc(8*2 + 264);
+    block_t *block_six = (block_t *)malloc(8*2 + 272);
+    block_t *block_seven = (block_t *)malloc(8*2 + 280);
+    block_set_size_and_allocated(block_four, 256, 0);
+    block_set_size_and_allocated(block_five, 264, 0);
+    block_set_size_and_allocated(block_six, 272, 0);
+    block_set_size_and_allocated(block_seven, 280, 0);
 
     insert_free_block(block_seven);
     insert_free_block(block_six);
@@ -335,34 +468,34 @@ void pull_free_block_test() {
     pull_free_block(block_four);
     
     sleep(1);
-    assert(block_five->payload[0] == (long)((char *)block_six));
-    assert(block_five->payload[1] == (long)((char *)block_seven));
+    assert(block_flink(block_five) == block_six);
+    assert(block_blink(block_five) == block_seven);
     
-    assert(block_seven->payload[0] == (long)((char *)block_five));
-    assert(block_seven->payload[1] == (long)((char *)block_six));
-    assert(flist_first != NULL);
-    assert((block_t *)flist_first == (block_t *) block_five);
+    assert(block_flink(block_seven) == block_five);
+    assert(block_blink(block_seven) == block_six);
+    assert(findex->flist_first[TEST_CLASS] != NULL);
+    assert((block_t *)findex->flist_first[TEST_CLASS] == (block_t *) block_five);
 
     pull_free_block(block_five);
     sleep(1);
-    assert(block_six->payload[1] == (long)((char *)block_seven));
-    assert(block_six->payload[0] == (long)((char *)block_seven));
+    assert(block_blink(block_six) == block_seven);
+    assert(block_flink(block_six) == block_seven);
 
-    assert(block_seven->payload[1] == (long)((char *)block_six));
-    assert(block_seven->payload[0] == (long)((char *)block_six));
-    assert(flist_first != NULL);
-    assert((block_t *)flist_first == (block_t *) block_six);
+    assert(block_blink(block_seven) == block_six);
+    assert(block_flink(block_seven) == block_six);
+    assert(findex->flist_first[TEST_CLASS] != NULL);
+    assert((block_t *)findex->flist_first[TEST_CLASS] == (block_t *) block_six);
 
     pull_free_block(block_six);
     sleep(1);
-    assert(block_seven->payload[1] == (long)((char *)block_seven));
-    assert(block_seven->payload[0] == (long)((char *)block_seven));
-    assert(flist_first != NULL);
-    assert((block_t *)flist_first == (block_t *) block_seven);
+    assert(block_blink(block_seven) == block_seven);
+    assert(block_flink(block_seven) == block_seven);
+    assert(findex->flist_first[TEST_CLASS] != NULL);
+    assert((block_t *)findex->flist_first[TEST_CLASS] == (block_t *) block_seven);
      
     pull_free_block(block_seven);
     sleep(1);
-    assert(flist_first == NULL);
+    assert(findex->flist_first[TEST_CLASS] == NULL);
 
     free(prologue);
     free(epilogue);
@@ -375,6 +508,531 @@ void pull_free_block_test() {
     free(block_seven);
 }
 
+void zeroed_test(){
+    block_t *block1 = (block_t *)malloc(8*2 + 48);
+    block_set_size_and_allocated(block1, 48, 0);
+    block_set_prev_allocated(block1, 1);
+
+    assert(block_zeroed(block1) == 0);
+    block_set_zeroed(block1, 1);
+    assert(block_zeroed(block1) == 1);
+    assert(block_size(block1) == 48);
+    assert(block_prev_allocated(block1) == 1);
+    assert(*block_end_tag(block1) == block1->size);
+
+    block_set_size(block1, 32); // shrinking keeps the bit
+    assert(block_zeroed(block1) == 1);
+    block_set_allocated(block1, 1); // allocating clears it
+    assert(block_zeroed(block1) == 0);
+    block_set_allocated(block1, 0);
+    assert(block_zeroed(block1) == 0);
+    assert(block_allocated(block1) == 0);
+
+    free(block1);
+}
+
+// a batch bigger than a whole region has to come back short instead of
+// running past the end of the heap
+void malloc_batch_test() {
+    mem_init();
+    assert(mm_init() == 0);
+    long n = (1L << 25) + 32;
+    void **out = calloc(n, sizeof(void *));
+    assert(out != NULL);
+
+    long got = mm_malloc_batch(120, n, out);
+    assert(got > 0 && got < n);
+    for (long i = 0; i < got; i++) {
+        assert(out[i] != NULL);
+        memset(out[i], 0x55, 120);
+    }
+    mm_free_batch(out, got);
+
+    free(out);
+    mem_deinit();
+}
+
+void calloc_test() {
+    mem_init();
+    assert(mm_init() == 0);
+
+    // a fresh heap's block comes straight from mem_sbrk
+    char *fresh = mm_calloc(1, 4000);
+    assert(fresh != NULL);
+    for (int j = 0; j < 4000; j++)
+        assert(fresh[j] == 0);
+    mm_free(fresh);
+
+    // dirty blocks, free them, and calloc the same sizes back
+    long sizes[] = {8, 24, 100, 300, 3000, 40000, 200000};
+    char *blocks[32];
+    char *dirty[32];
+    int reused = 0;
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        long size = sizes[s];
+        for (int i = 0; i < 32; i++) {
+            dirty[i] = mm_malloc(size);
+            assert(dirty[i] != NULL);
+            memset(dirty[i], 0xa5, mm_usable_size(dirty[i]));
+        }
+        for (int i = 0; i < 32; i++)
+            mm_free(dirty[i]);
+        for (int i = 0; i < 32; i++) {
+            blocks[i] = mm_calloc(size, 1);
+            assert(blocks[i] != NULL);
+            for (long j = 0; j < size; j++)
+                assert(blocks[i][j] == 0);
+            for (int k = 0; k < 32; k++)
+                reused += blocks[i] == dirty[k];
+        }
+        for (int i = 0; i < 32; i++)
+            mm_free(blocks[i]);
+    }
+    assert(reused > 0);
+
+    // the product overflows a long
+    assert(mm_calloc(LONG_MAX, 2) == NULL);
+    mem_deinit();
+}
+
+void memalign_test() {
+    mem_init();
+    assert(mm_init() == 0);
+
+    long sizes[] = {1, 40, 200, 1000, 5000};
+    int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    char *blocks[9 * 5];
+    long lens[9 * 5];
+    int n = 0;
+    for (long alignment = 16; alignment <= 4096; alignment *= 2) {
+        for (int s = 0; s < nsizes; s++) {
+            char *p = mm_memalign(alignment, sizes[s]);
+            assert(p != NULL);
+            assert((long)p % alignment == 0);
+            lens[n] = mm_usable_size(p);
+            assert(lens[n] >= sizes[s]);
+            // no payload may overlap one handed out before it
+            for (int i = 0; i < n; i++)
+                assert(p + lens[n] <= blocks[i] || blocks[i] + lens[i] <= p);
+            memset(p, n, lens[n]);
+            blocks[n++] = p;
+        }
+    }
+
+    // every payload still holds its own fill
+    for (int i = 0; i < n; i++)
+        for (long j = 0; j < lens[i]; j++)
+            assert(blocks[i][j] == (char)i);
+
+    // aligned blocks go back through mm_free and mm_realloc like any other
+    for (int i = 0; i < n; i++) {
+        if (i % 2 == 0) {
+            mm_free(blocks[i]);
+            continue;
+        }
+        char *p = mm_realloc(blocks[i], lens[i] * 2);
+        assert(p != NULL);
+        for (long j = 0; j < lens[i]; j++)
+            assert(p[j] == (char)i);
+        mm_free(p);
+    }
+
+    // an alignment no region can hold fails cleanly
+    assert(mm_memalign(2L * MAX_HEAP, 64) == NULL);
+    assert(mm_memalign(1L << 40, 64) == NULL);
+    assert(mm_memalign(4096, 1L << 40) == NULL);
+    mem_deinit();
+}
+
+// mm.c's QUICK_MAX_BYTES; the test assumes the default QUICK_LISTS=1 build
+#define TEST_QUICK_MAX_BYTES (16 * 1024)
+
+void quick_lists_test() {
+    mem_init();
+    assert(mm_init() == 0);
+
+    // 400 bytes is past the thread cache and under QUICK_MAX_SIZE. A batch
+    // is carved side by side, so frees can coalesce; the ends stay as guards
+    char *p[66];
+    assert(mm_malloc_batch(400, 66, (void **)p) == 66);
+    for (int i = 0; i < 65; i++)
+        assert(block_next(payload_to_block(p[i])) == payload_to_block(p[i + 1]));
+    char *guard = p[0];
+    block_t *first = payload_to_block(p[1]);
+    long bsize = block_size(first);
+
+    // an exact-size hit gets the same block back, unsplit
+    mm_free(p[5]);
+    assert(block_allocated(payload_to_block(p[5])));  // not coalesced yet
+    assert(mm_malloc(400) == p[5]);
+    assert(block_size(payload_to_block(p[5])) == bsize);
+
+    // a malloc another free block can serve leaves the quick lists alone
+    char *big = mm_malloc(4000);
+    char *fence = mm_malloc(400);
+    mm_free(big);
+    mm_free(p[5]);
+    assert(mm_malloc(1000) != NULL);
+    assert(block_allocated(payload_to_block(p[5])));
+    assert(mm_malloc(400) == p[5]);
+
+    // crossing QUICK_MAX_BYTES frees and coalesces them all at once
+    int n = TEST_QUICK_MAX_BYTES / bsize;
+    for (int i = 1; i <= n; i++)
+        mm_free(p[i]);
+    assert(block_allocated(first));
+    mm_free(p[n + 1]);
+    assert(!block_allocated(first));
+    assert(block_size(first) == (n + 1) * bsize);
+    assert(block_allocated(payload_to_block(guard)));
+    assert(block_allocated(payload_to_block(p[n + 2])));
+
+    mm_free(fence);
+    mem_deinit();
+}
+
+// mm.c's RUN_SIZE and TCACHE_COUNT
+#define TEST_RUN_SIZE 4096
+#define TEST_TCACHE_COUNT 7
+
+void slab_test() {
+    mem_init();
+    assert(mm_init() == 0);
+
+    // a batch (unlike mm_malloc) skips the thread cache, and the first run
+    // fills up slot by slot before the next one is started
+    char *p[200];
+    assert(mm_malloc_batch(48, 200, (void **)p) == 200);
+    char *page = (char *)((long)p[0] & ~(long)(TEST_RUN_SIZE - 1));
+    int k = 0;
+    while (k < 200 && p[k] >= page && p[k] < page + TEST_RUN_SIZE) {
+        assert(p[k] == p[0] + 48 * k);
+        // the slot's run is found by masking its address
+        assert(mm_usable_size(p[k]) == 48);
+        k++;
+    }
+    assert(k > 1 && k < 200);
+
+    // once the cache's bin is full, frees go back to the run
+    mm_free_batch((void **)&p[200 - TEST_TCACHE_COUNT], TEST_TCACHE_COUNT);
+    mm_free_batch((void **)&p[k / 2], 1);
+    char *again[2];
+    assert(mm_malloc_batch(48, 2, (void **)again) == 2);
+    assert(again[0] == p[k / 2]);
+    p[k / 2] = again[0];
+
+    // a run left empty, while another run of its size has free slots, goes
+    // back to the heap as a free block
+    block_t *run_block = payload_to_block(page);
+    assert(block_allocated(run_block));
+    block_t *start =
+        block_prev_allocated(run_block) ? run_block : block_prev(run_block);
+    mm_free_batch((void **)p, k);
+    assert(!block_allocated(start));
+    assert((char *)start + block_size(start) >= page + TEST_RUN_SIZE);
+
+    // every small size gets a slot of the next multiple of 16
+    long sizes[] = {1, 20, 40, 64};
+    for (int s = 0; s < 4; s++) {
+        void *pair[2];
+        assert(mm_malloc_batch(sizes[s], 2, pair) == 2);
+        assert(mm_usable_size(pair[0]) == 16 * (s + 1));
+        mm_free_batch(pair, 2);
+    }
+
+    mem_deinit();
+}
+
+// mm.c's MMAP_THRESHOLD
+#define TEST_MMAP_THRESHOLD (128 * 1024)
+
+void mapped_test() {
+    mem_init();
+    assert(mm_init() == 0);
+    long t = TEST_MMAP_THRESHOLD;
+
+    // a request at the threshold gets a mapping of its own, and its header
+    // covers the whole mapping
+    char *p = mm_malloc(t);
+    assert(p != NULL);
+    assert(mem_mapped(p - ALLOC_TAGS_SIZE, p + t - 1));
+    long usable = mm_usable_size(p);
+    assert(usable >= t && usable < t + mem_pagesize());
+    assert((long)(p + usable) % mem_pagesize() == 0);
+    // one byte less stays in the arena
+    char *small = mm_malloc(t - 1);
+    assert(small != NULL && !mem_mapped(small, small));
+    mm_free(small);
+
+    // growing remaps it, keeping the payload
+    for (long i = 0; i < t; i++)
+        p[i] = (char)(i * 7);
+    char *grown = mm_realloc(p, 4 * t);
+    assert(grown != NULL);
+    assert(mem_mapped(grown - ALLOC_TAGS_SIZE, grown + 4 * t - 1));
+    assert(mm_usable_size(grown) >= 4 * t);
+    for (long i = 0; i < t; i++)
+        assert(grown[i] == (char)(i * 7));
+
+    // shrinking below the threshold moves it back into the arena
+    char *shrunk = mm_realloc(grown, 1000);
+    assert(shrunk != NULL);
+    assert(!mem_mapped(shrunk, shrunk));
+    assert(!mem_mapped(grown, grown));
+    for (long i = 0; i < 1000; i++)
+        assert(shrunk[i] == (char)(i * 7));
+    mm_free(shrunk);
+
+    // freeing a mapped block unmaps it
+    char *q = mm_malloc(2 * t);
+    assert(mem_mapped(q, q + 2 * t - 1));
+    mm_free(q);
+    assert(!mem_mapped(q, q));
+
+    mem_deinit();
+}
+
+// mm.c's FIT_BUDGET, which the Makefile also passes to the budget build
+#ifndef FIT_BUDGET
+#define FIT_BUDGET 0
+#endif
+
+// mallocs blocks of the given payload sizes, each next to an allocated guard
+// so no two can merge, then frees them in order. Blocks of 576 to 639 bytes
+// share a size class and are not kept on a quick list.
+void free_apart(const long *payloads, int n, char **blocks) {
+    // they all come out of one free block, with no gaps between them
+    mm_free(mm_malloc(40000));
+    for (int i = 0; i < n; i++) {
+        blocks[i] = mm_malloc(payloads[i]);
+        assert(mm_malloc(1000) != NULL);
+    }
+    for (int i = 0; i < n; i++) {
+        mm_free(blocks[i]);
+        block_t *b = payload_to_block(blocks[i]);
+        assert(!block_allocated(b));
+        assert(block_size(b) == payloads[i] + ALLOC_TAGS_SIZE);
+        assert(block_prev_allocated(b) && block_next_allocated(b));
+    }
+}
+
+// checks whether a payload was split off the top of the free block that held
+// the given payload (whose header now describes the rest)
+int carved_from(char *ptr, char *from, long payload) {
+    return ptr >= from && ptr < from + payload;
+}
+
+void placement_test() {
+    char *t[6];
+
+    // the 576-byte block fits best, but the 600-byte one heads the list
+    mem_init();
+    assert(mm_init() == 0);
+    long mixed[] = {576, 624, 600};
+    free_apart(mixed, 3, t);
+    char *p = mm_malloc(570);
+#if PLACEMENT == FIT_BEST || PLACEMENT == FIT_GOOD
+    assert(p == t[0]);
+#else
+    assert(carved_from(p, t[2], 600));
+#endif
+    mem_deinit();
+
+    // the list is 576 (head), 624, 576, 624; the first malloc takes the
+    // first 624, and the next search picks up after it
+    mem_init();
+    assert(mm_init() == 0);
+    long alternating[] = {624, 576, 624, 576};
+    free_apart(alternating, 4, t);
+    assert(carved_from(mm_malloc(600), t[2], 624));
+    p = mm_malloc(576);
+#if PLACEMENT == FIT_NEXT
+    assert(p == t[1]);
+#else
+    assert(p == t[3]);
+#endif
+    mem_deinit();
+
+    // four 576-byte blocks that do not fit come before the only fit in the
+    // class, and a 672-byte block waits in the next class
+    mem_init();
+    assert(mm_init() == 0);
+    long crowded[] = {624, 576, 576, 576, 576, 672};
+    free_apart(crowded, 6, t);
+    p = mm_malloc(600);
+#if FIT_BUDGET > 0 && FIT_BUDGET <= 4
+    assert(carved_from(p, t[5], 672));  // out of budget, so the next class
+#else
+    assert(carved_from(p, t[0], 624));
+#endif
+    mem_deinit();
+}
+
+#if ADDRESS_ORDERED
+// checks that the list of class is in address order, that every level k of
+// its skip list is an ordered subsequence of level k - 1 holding exactly the
+// blocks tall enough for it, and that live[0..n) are the blocks on the list
+void check_skip_list(int class, block_t **live, int n) {
+    block_t *head = findex->flist_first[class];
+    int count = 0;
+    if (head != NULL) {
+        block_t *b = head;
+        do {
+            assert(block_blink(block_flink(b)) == b);
+            assert(block_flink(b) == head || block_flink(b) > b);
+            count++;
+            b = block_flink(b);
+        } while (b != head);
+    }
+    assert(count == n);
+
+    for (int k = 1; k <= SKIP_LEVELS; k++) {
+        int tall = 0;
+        for (int i = 0; i < n; i++)
+            tall += skip_height(live[i]) >= k;
+        count = 0;
+        block_t *below = k == 1 ? head : findex->skip_first[class][k - 2];
+        for (block_t *b = findex->skip_first[class][k - 1]; b != NULL;
+             b = skip_next(b, k)) {
+            assert(skip_height(b) >= k);
+            // b must come up on the level below before anything past it
+            while (below != b) {
+                assert(below != NULL && below < b);
+                below = k == 1 ? block_flink(below) : skip_next(below, k - 1);
+            }
+            assert(skip_next(b, k) == NULL || skip_next(b, k) > b);
+            count++;
+        }
+        assert(count == tall);
+    }
+}
+
+// inserts blocks of bsize bytes into one class in random order, then pulls
+// them in random order, every few pulls taking the lowest-addressed block
+void skip_list_run(long bsize, int n) {
+    int class = size_class(bsize);
+    long stride = bsize + 2 * ALIGNMENT;
+    char *buf = malloc(n * stride);
+    block_t **blocks = malloc(n * sizeof(block_t *));
+    block_t **live = malloc(n * sizeof(block_t *));
+    findex->flist_first[class] = NULL;
+    memset(findex->skip_first[class], 0, sizeof(findex->skip_first[class]));
+
+    for (int i = 0; i < n; i++) {
+        blocks[i] = (block_t *)(buf + i * stride);
+        block_set_size_and_allocated(blocks[i], bsize, 0);
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        block_t *t = blocks[i];
+        blocks[i] = blocks[j];
+        blocks[j] = t;
+    }
+    for (int i = 0; i < n; i++) {
+        insert_free_block(blocks[i]);
+        live[i] = blocks[i];
+        check_skip_list(class, live, i + 1);
+    }
+
+    for (int left = n; left > 0; left--) {
+        int i = rand() % left;
+        if (left % 3 == 0) {  // the head is also first on every level
+            for (int j = 0; j < left; j++)
+                if (live[j] == findex->flist_first[class])
+                    i = j;
+        }
+        pull_free_block(live[i]);
+        live[i] = live[left - 1];
+        check_skip_list(class, live, left - 1);
+    }
+    assert(findex->flist_first[class] == NULL);
+
+    free(live);
+    free(blocks);
+    free(buf);
+}
+
+void skip_list_test() {
+    srand(1);
+    findex->fl_bitmap = 0;
+    memset(findex->sl_bitmap, 0, sizeof(findex->sl_bitmap));
+    skip_list_run(256, 300);
+    // the smallest classes have little or no room for skip links
+    skip_list_run(MINBLOCKSIZE, 100);
+    skip_list_run(MINBLOCKSIZE + ALIGNMENT, 100);
+}
+#endif
+
+#if SIZE_INDEX
+// checks that the size index of class matches its list: the count always,
+// and while the index covers the class, each entry from the tail to the head
+void check_size_index(int class) {
+    block_t *head = findex->flist_first[class];
+    int count = 0;
+    if (head != NULL) {
+        block_t *b = head;
+        do {
+            count++;
+            b = block_flink(b);
+        } while (b != head);
+    }
+    assert(findex->index_count[class] == count);
+    if (count > SIZE_INDEX_SLOTS) {
+        return;
+    }
+    block_t *b = head == NULL ? NULL : block_blink(head);
+    for (int i = 0; i < count; i++, b = block_blink(b)) {
+        assert(findex->index_size[class][i] == block_size(b));
+        assert(findex->index_offset[class][i] == (char *)b - findex->base);
+    }
+    for (int i = count; i < SIZE_INDEX_SLOTS; i++)
+        assert(findex->index_size[class][i] == 0);
+}
+
+void size_index_test() {
+    // each lane is compared on its own, the last one included
+    int sizes[8] = {256, 256, 256, 256, 256, 256, 256, 280};
+    assert(size_index_fits(sizes, 272) == 0x80);
+    assert(size_index_fits(sizes, 280) == 0x80);
+    assert(size_index_fits(sizes, 281) == 0);
+    assert(size_index_fits(sizes, 256) == 0xff);
+    int unused[8] = {264, 0, 0, 0, 0, 0, 0, 0};
+    assert(size_index_fits(unused, 16) == 0x01);
+
+    srand(1);
+    findex->fl_bitmap = 0;
+    memset(findex->sl_bitmap, 0, sizeof(findex->sl_bitmap));
+    findex->flist_first[TEST_CLASS] = NULL;
+    memset(findex->index_size[TEST_CLASS], 0,
+           sizeof(findex->index_size[TEST_CLASS]));
+    findex->index_count[TEST_CLASS] = 0;
+
+    // inserts run past the slots, so pulls have to rebuild the index
+    int n = SIZE_INDEX_SLOTS + 8;
+    block_t *live[SIZE_INDEX_SLOTS + 8];
+    for (int i = 0; i < n; i++) {
+        long size = 256 + 8 * (rand() % 4);
+        live[i] = (block_t *)malloc(8*2 + size);
+        block_set_size_and_allocated(live[i], size, 0);
+        insert_free_block(live[i]);
+        check_size_index(TEST_CLASS);
+    }
+    for (int left = n; left > 0; left--) {
+        int i = rand() % left;
+        if (left % 4 == 0) {  // the head, which is the index's last entry
+            for (int j = 0; j < left; j++)
+                if (live[j] == findex->flist_first[TEST_CLASS])
+                    i = j;
+        }
+        pull_free_block(live[i]);
+        free(live[i]);
+        live[i] = live[left - 1];
+        check_size_index(TEST_CLASS);
+    }
+    assert(findex->flist_first[TEST_CLASS] == NULL);
+}
+#endif
+
 int total_tests, num_correct, num_incorrect;
 int run_test_in_separate_process(void (*func)(), int num_tests, const char *message) {
     printf("running test: ");
@@ -400,8 +1058,19 @@ void foreach_test(int num_tests, char const *test_names[],
         functions_passed += wrapper(&prev_size_allocated_test, 15, "prev_size_and_allocated");
         functions_passed += wrapper(&set_blink_test,5, "set_blink");
         functions_passed += wrapper(&set_flink_test, 6, "set_flink");
+        functions_passed += wrapper(&size_class_test, 17, "size_class");
+        functions_passed += wrapper(&next_free_class_test, 18, "next_free_class");
+        functions_passed += wrapper(&tree_test, 19, "tree");
+        functions_passed += wrapper(&zeroed_test, 20, "block_zeroed");
         functions_passed += wrapper(&insert_free_block_test, 16, "insert_free_block");
         functions_passed += wrapper(&pull_free_block_test, 4, "pull_free_block");
+        functions_passed += wrapper(&malloc_batch_test, 21, "malloc_batch");
+        functions_passed += wrapper(&calloc_test, 22, "calloc");
+        functions_passed += wrapper(&memalign_test, 23, "memalign");
+        functions_passed += wrapper(&quick_lists_test, 24, "quick_lists");
+        functions_passed += wrapper(&slab_test, 27, "slab");
+        functions_passed += wrapper(&mapped_test, 28, "mapped");
+        functions_passed += wrapper(&placement_test, 29, "placement");
         return;
     }
 
@@ -414,6 +1083,36 @@ void foreach_test(int num_tests, char const *test_names[],
             functions_passed += wrapper(&set_blink_test,5, "set_blink");
         else if (!strcmp(test_name, "set_flink"))
             functions_passed += wrapper(&set_flink_test, 6, "set_flink");
+        else if (!strcmp(test_name, "size_class"))
+            functions_passed += wrapper(&size_class_test, 17, "size_class");
+        else if (!strcmp(test_name, "next_free_class"))
+            functions_passed += wrapper(&next_free_class_test, 18, "next_free_class");
+        else if (!strcmp(test_name, "tree"))
+            functions_passed += wrapper(&tree_test, 19, "tree");
+        else if (!strcmp(test_name, "malloc_batch"))
+            functions_passed += wrapper(&malloc_batch_test, 21, "malloc_batch");
+        else if (!strcmp(test_name, "calloc"))
+            functions_passed += wrapper(&calloc_test, 22, "calloc");
+        else if (!strcmp(test_name, "memalign"))
+            functions_passed += wrapper(&memalign_test, 23, "memalign");
+        else if (!strcmp(test_name, "quick_lists"))
+            functions_passed += wrapper(&quick_lists_test, 24, "quick_lists");
+        else if (!strcmp(test_name, "slab"))
+            functions_passed += wrapper(&slab_test, 27, "slab");
+        else if (!strcmp(test_name, "mapped"))
+            functions_passed += wrapper(&mapped_test, 28, "mapped");
+        else if (!strcmp(test_name, "placement"))
+            functions_passed += wrapper(&placement_test, 29, "placement");
+#if ADDRESS_ORDERED
+        else if (!strcmp(test_name, "skip_list"))
+            functions_passed += wrapper(&skip_list_test, 25, "skip_list");
+#endif
+#if SIZE_INDEX
+        else if (!strcmp(test_name, "size_index"))
+            functions_passed += wrapper(&size_index_test, 26, "size_index");
+#endif
+        else if (!strcmp(test_name, "block_zeroed"))
+            functions_passed += wrapper(&zeroed_test, 20, "block_zeroed");
         else if (!strcmp(test_name, "insert_free_block"))
             functions_passed += wrapper(&insert_free_block_test, 16, "insert_free_block");
         else if (!strcmp(test_name, "pull_free_block"))
@@ -443,6 +1142,9 @@ void foreach_test(int num_tests, char const *test_names[],
 
 int main(int argc, char const *argv[]){
     printf("Testing for correctness...\n");
+    findex = &test_index;
+    // the list links are offsets from base, so it has to be near the blocks
+    test_index.base = malloc(1);
 
     if (argc < 2){
         printf("USAGE: %s\n", USAGE);
@@ -1,11 +1,100 @@
 #ifndef MMINLINE_H_
 #define MMINLINE_H_
 #include <assert.h>
+#include <string.h>
 #include "mm.h"
 
-static block_t *flist_first;  // head of circular, doubly linked free list
-extern block_t *prologue;
-extern block_t *epilogue;
+// The segregated free lists form a two-level (TLSF-style) index. The first
+// level splits sizes into power-of-two ranges [2^f, 2^(f+1)) starting at
+// MINBLOCKSIZE, and the second level splits each of those ranges into
+// SL_COUNT equal subranges. The lists only cover blocks smaller than
+// LARGE_BLOCK_SIZE; larger free blocks are kept in a size-ordered tree.
+#define FL_MIN_SHIFT 4  // log2(MINBLOCKSIZE)
+#define FL_COUNT 6
+#define SL_INDEX_BITS 3
+#define SL_COUNT (1 << SL_INDEX_BITS)
+#define NUM_SIZE_CLASSES (FL_COUNT * SL_COUNT)
+// Free blocks at least this big live in the best-fit tree instead of a list
+#define LARGE_BLOCK_SIZE (1L << (FL_MIN_SHIFT + FL_COUNT))
+// Payload words of a free block that hold list or tree links
+#define FREE_LINK_WORDS 3
+
+// When set to 1, every free list is kept in address order instead of LIFO
+// order, so the first fit in a list is the lowest-addressed one. A skip list
+// over each list keeps inserts O(log n), except in the two smallest classes:
+// a MINBLOCKSIZE block has no room for a skip link and the next size only for
+// level 1, so inserts there still walk most of the list. Build with
+// -D ADDRESS_ORDERED=1 to enable it.
+#ifndef ADDRESS_ORDERED
+#define ADDRESS_ORDERED 0
+#endif
+// Levels of the skip list above the free list itself
+#define SKIP_LEVELS 5
+
+// The placement policy find_fit in mm.c uses within a size class. Build with
+// -D PLACEMENT=<policy> to change it.
+#define FIT_FIRST 0  // the first block in the list that fits
+#define FIT_NEXT 1   // the first that fits, starting where the last fit was
+#define FIT_BEST 2   // the smallest block that fits
+#define FIT_GOOD 3   // the smallest fit among a bounded number of blocks
+#ifndef PLACEMENT
+#define PLACEMENT FIT_FIRST
+#endif
+
+// When set to 1, each size class also keeps the sizes of its free blocks in a
+// dense array, newest last, and find_fit in mm.c scans that array with SIMD
+// compares (8 sizes at a time with AVX2, 4 with SSE2) instead of walking the
+// list. A class with more than SIZE_INDEX_SLOTS free blocks is walked as
+// usual. Build with -D SIZE_INDEX=1 to enable it.
+#ifndef SIZE_INDEX
+#define SIZE_INDEX 0
+#endif
+// Entries in the size index of each class (a multiple of 8)
+#define SIZE_INDEX_SLOTS 32
+#if SIZE_INDEX && (ADDRESS_ORDERED || PLACEMENT == FIT_NEXT)
+#error "SIZE_INDEX keeps each class in LIFO order and has no rover"
+#endif
+#if SIZE_INDEX && defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// The free blocks of one arena: the heads of the circular, doubly linked free
+// lists (one per size class), the bitmaps over them and the tree of large free
+// blocks. Every arena in mm.c has its own.
+typedef struct free_index {
+   block_t *flist_first[NUM_SIZE_CLASSES];
+   // bit f is set iff some list in first-level range f is non-empty
+   unsigned int fl_bitmap;
+   // bit s of sl_bitmap[f] is set iff flist_first[f * SL_COUNT + s] is
+   // non-empty
+   unsigned int sl_bitmap[FL_COUNT];
+   // root of the treap of large free blocks, ordered by (size, address)
+   block_t *ftree_root;
+   // the start of the arena's region; list links are 32-bit offsets from here
+   char *base;
+#if ADDRESS_ORDERED
+   // skip_first[c][k - 1] is the lowest-addressed block on level k of the
+   // skip list over class c, or NULL if the level is empty
+   block_t *skip_first[NUM_SIZE_CLASSES][SKIP_LEVELS];
+#endif
+#if PLACEMENT == FIT_NEXT
+   // rover[c] is where the next search of class c starts (NULL: at the head)
+   block_t *rover[NUM_SIZE_CLASSES];
+#endif
+#if SIZE_INDEX
+   // index_count[c] is the number of free blocks in class c. While it is at
+   // most SIZE_INDEX_SLOTS, index_size[c][i] and index_offset[c][i] are the
+   // size and the offset from base of the block i places from the tail of the
+   // list (so the head is last), and the unused sizes are 0
+   int index_size[NUM_SIZE_CLASSES][SIZE_INDEX_SLOTS];
+   int index_offset[NUM_SIZE_CLASSES][SIZE_INDEX_SLOTS];
+   int index_count[NUM_SIZE_CLASSES];
+#endif
+} free_index_t;
+
+// the index the helpers below work on; mm.c points it at the index of the
+// arena the calling thread has locked
+static __thread free_index_t *findex;
 
 /**
  * In order to pass the tests sequentially, you must implement the inline
@@ -33,12 +122,13 @@ static inline int block_allocated(block_t *b) {
  * [_)|(_)(_ | \____(/,[ )(_]____ | (_](_]
  *                                     ._|
  * returns a pointer to the block's end tag (You probably won't need to use this
- * directly)
+ * directly). NOTE: only free blocks have an end tag, which is the low half of
+ * their last word; in an allocated block this word is part of the payload
  */
-static inline long *block_end_tag(block_t *b) {
+static inline unsigned int *block_end_tag(block_t *b) {
    assert(b->size >= (WORD_SIZE * 2));
  
-   return (long *)(&b->payload[b->size/8 - 2]); 
+   return (unsigned int *)(&b->payload[b->size/8 - 2]); 
 }
 
 /*
@@ -51,7 +141,7 @@ static inline long *block_end_tag(block_t *b) {
  */
 static inline int block_end_allocated(block_t *b) {
 
-   long end_size = b->payload[b->size/8 - 2];
+   unsigned int end_size = *block_end_tag(b);
    return end_size & 1;
 }
 
@@ -59,9 +149,10 @@ static inline int block_end_allocated(block_t *b) {
  * |_ | _  _.;_/     __ _ -+-     __*__. _
  * [_)|(_)(_.| \_____) (/, | _____) | /_(/,
  *
- * Sets the entire size of the block at both the beginning and the end tags
- * Preserves the alloc bit (if b is marked allocated or free, it will remain
- * so).
+ * Sets the entire size of the block at the beginning tag, and at the end tag
+ * if the block is free (allocated blocks have no end tag).
+ * Preserves the alloc, prev-alloc and zeroed bits (if b is marked allocated or
+ * free, it will remain so).
  * NOTE: size must be a multiple of ALIGNMENT, which means that in binary, its
  * right-most 3 bits must be 0. Thus, we can check if size is a multiple of
  * ALIGNMENT by &-ing it with ALIGNMENT - 1, which is 00..00111 in binary if
@@ -71,9 +162,11 @@ static inline int block_end_allocated(block_t *b) {
 static inline void block_set_size(block_t *b, long size) {
    assert((size & (ALIGNMENT - 1)) == 0);
 
-   size |= block_allocated(b);
+   size |= b->size & 7;
    b->size = size; 
-   *block_end_tag(b) = size; 
+   if (!block_allocated(b)) { //only free blocks keep an end tag
+      *block_end_tag(b) = size; 
+   }
 }
 
 /*
@@ -81,12 +174,12 @@ static inline void block_set_size(block_t *b, long size) {
  * [_)|(_)(_.| \____) | /_(/,
  *
  * returns the size of the entire block
- * NOTE: Think about how to use & to remove the is-allocated bit
- * from the size
+ * NOTE: -8 is 111...1000 in binary, which removes the is-allocated and
+ * prev-allocated bits from the size
  */
 static inline long block_size(block_t *b) {
 
-   return b->size & -2;
+   return b->size & -8;
 }
 
 /**
@@ -98,18 +191,19 @@ static inline long block_size(block_t *b) {
  * |_ | _  _.;_/     __ _ -+-     _.|| _  _. _.-+- _  _|
  * [_)|(_)(_.| \_____) (/, | ____(_]||(_)(_.(_] | (/,(_]
  *
- * Sets the allocated flags of the block, at both the beginning and the end
- * tags. NOTE: -2 is 111...1110 in binary
+ * Sets the allocated flag of the block. Freeing a block also writes its end
+ * tag, since only free blocks have one. Either way the zeroed bit is
+ * cleared, since the payload now belongs (or belonged) to the user.
+ * NOTE: -5 is 111...1011 and -6 is 111...1010 in binary
  */
 static inline void block_set_allocated(block_t *b, int allocated) {
    assert((allocated == 0) || (allocated == 1));
 
    if (allocated) { //checks is allocated is 1
-        b->size |= allocated;
-        *block_end_tag(b) |= allocated;
+        b->size = (b->size | allocated) & -5;
    } else { //checks if allocated is 0
-        b->size &= -2;
-        *block_end_tag(b) &= -2;
+        b->size &= -6;
+        *block_end_tag(b) = b->size;
    }
 }
 
@@ -122,14 +216,20 @@ static inline void block_set_allocated(block_t *b, int allocated) {
  * |_ | _  _.;_/   __ _ -+-   __*__. _    _.._  _|   _.|| _  _. _.-+- _  _|
  * [_)|(_)(_.| \___) (/, | ___) | /_(/,__(_][ )(_]__(_]||(_)(_.(_] | (/,(_]
  *
- * Sets the entire size of the block and sets the allocated flags of the block,
- * at both the beginning and the end
+ * Sets the entire size of the block and sets the allocated flag of the block,
+ * writing the end tag only if the block ends up free. The header is written
+ * in one go so that no stale end tag lands in the payload of a block that is
+ * being allocated. Clears the zeroed bit.
  */
 static inline void block_set_size_and_allocated(block_t *b, long size,
                                                int allocated) {
+   assert((size & (ALIGNMENT - 1)) == 0);
+   assert((allocated == 0) || (allocated == 1));
 
-   block_set_size(b, size);
-   block_set_allocated(b, allocated);
+   b->size = size | allocated | (b->size & 2);
+   if (!allocated) { //only free blocks keep an end tag
+      *block_end_tag(b) = b->size;
+   }
 }
 
 /**
@@ -145,7 +245,7 @@ static inline void block_set_size_and_allocated(block_t *b, long size,
  */
 static inline long block_end_size(block_t *b) {
 
-   return *block_end_tag(b) & -2;
+   return *block_end_tag(b) & -8;
 }
 
 /**
@@ -153,16 +253,76 @@ static inline long block_end_size(block_t *b) {
  * test will pass
  */
 
+/*
+ * |_ | _  _.;_/    ._ ._. _ .  ,     _.|| _  _. _.-+- _  _|
+ * [_)|(_)(_.| \____[_)[  (/, \/ ____(_]||(_)(_.(_] | (/,(_]
+ *                  |
+ *
+ * returns 1 if the previous block is allocated, 0 otherwise. This is kept in
+ * the second-lowest bit of b's own header, so the previous block's end tag
+ * never needs to be read
+ */
+static inline int block_prev_allocated(block_t *b) {
+
+   return (b->size & 2) >> 1;
+}
+
+/*
+ * block_set_prev_allocated:
+ * records in b's header whether the block before b is allocated. Must be
+ * updated whenever the previous block is allocated or freed. NOTE: b may be
+ * an allocated block whose owner is reading its size without the arena's
+ * lock (see usable_size in mm.c), so the bit is flipped atomically
+ */
+static inline void block_set_prev_allocated(block_t *b, int prev_allocated) {
+   assert((prev_allocated == 0) || (prev_allocated == 1));
+
+   if (prev_allocated) {
+       __atomic_fetch_or(&b->size, 2U, __ATOMIC_RELAXED);
+   } else {
+       __atomic_fetch_and(&b->size, ~2U, __ATOMIC_RELAXED);
+   }
+}
+
+/*
+ * block_zeroed:
+ * returns 1 if b is a free block whose payload is known to be zero, apart
+ * from its first FREE_LINK_WORDS words and its end tag, 0 otherwise. This is
+ * kept in the third-lowest bit of b's header
+ */
+static inline int block_zeroed(block_t *b) {
+
+   return (b->size & 4) >> 2;
+}
+
+/*
+ * block_set_zeroed:
+ * records whether the free block b is known to be zero (see block_zeroed)
+ */
+static inline void block_set_zeroed(block_t *b, int zeroed) {
+   assert((zeroed == 0) || (zeroed == 1));
+   assert(!block_allocated(b));
+
+   if (zeroed) {
+       b->size |= 4;
+   } else {
+       b->size &= -5;
+   }
+   *block_end_tag(b) = b->size;
+}
+
 /*
  * |_ | _  _.;_/    _ ._. _ .  ,   __*__. _
  * [_)|(_)(_.| \___[_)[  (/, \/ ___) | /_(/,
  *                  |
  *
- * returns the size of the previous block. NOTE: -2 is 111...1110 in binary
+ * returns the size of the previous block, read from its end tag. NOTE: only
+ * valid if the previous block is free, since allocated blocks have no end tag
  */
 static inline long block_prev_size(block_t *b) {
+    assert(!block_prev_allocated(b));
 
-    return b->payload[-2] & -2;
+    return *(unsigned int *)&b->payload[-2] & -8;
 }
 
 /*
@@ -245,18 +405,6 @@ static inline long block_next_size(block_t *b) {
  * test will pass
  */
 
-/*
- * |_ | _  _.;_/    ._ ._. _ .  ,     _.|| _  _. _.-+- _  _|
- * [_)|(_)(_.| \____[_)[  (/, \/ ____(_]||(_)(_.(_] | (/,(_]
- *                  |
- *
- * returns 1 if the previous block is allocated, 0 otherwise
- */
-static inline int block_prev_allocated(block_t *b) {
-
-   return b->payload[-2] & 1;
-}
-
 /**
  * If all functions previous to this line are complete, prev_size_and_allocated
  * test will pass
@@ -267,13 +415,13 @@ static inline int block_prev_allocated(block_t *b) {
  * [_)|(_)(_.| \____[_)||[ )| \
  *
  * given the input block 'b', returns b's blink, which points to the
- * previous block in the free list. NOTE: if 'b' is free, b->payload[1]
- * contains b's blink
+ * previous block in the free list. NOTE: if 'b' is free, the high half of
+ * b->payload[0] holds b's blink as an offset from findex->base
  */
 static inline block_t *block_blink(block_t *b) {
    assert(!block_allocated(b));
 
-    return (block_t *)b->payload[1]; 
+    return (block_t *)(findex->base + ((int *)b->payload)[1]); 
 }
 
 /*
@@ -286,7 +434,7 @@ static inline block_t *block_blink(block_t *b) {
 static inline void block_set_blink(block_t *b, block_t *new_blink) {
    assert(!block_allocated(b) && !block_allocated(new_blink));
 
-   b->payload[1] = (long) new_blink;
+   ((int *)b->payload)[1] = (int)((char *)new_blink - findex->base);
 }
 
 /**
@@ -299,12 +447,13 @@ static inline void block_set_blink(block_t *b, block_t *new_blink) {
  * [_)|(_)(_.| \____| ||[ )| \
  *
  * given the input block 'b', returns b's flink, which points to the next block
- * in the free list.NOTE: if 'b' is free, b->payload[0] contains b's flink
+ * in the free list.NOTE: if 'b' is free, b->flink holds b's flink as an
+ * offset from findex->base
  */
 static inline block_t *block_flink(block_t *b) {
    assert(!block_allocated(b));
 
-   return (block_t *)b->payload[0]; 
+   return (block_t *)(findex->base + b->flink); 
 }
 
 /*
@@ -318,7 +467,7 @@ static inline block_t *block_flink(block_t *b) {
 static inline void block_set_flink(block_t *b, block_t *new_flink) {
    assert(!block_allocated(b) && !block_allocated(new_flink));
 
-   b->payload[0] = (long) new_flink;
+   b->flink = (int)((char *)new_flink - findex->base);
 }
 
 /**
@@ -326,30 +475,450 @@ static inline void block_set_flink(block_t *b, block_t *new_flink) {
  * test will pass
  */
 
+/*
+ * size_class:
+ * returns the index of the segregated free list that holds blocks of the
+ * given size. The first-level index is floor(log2(size)) and the
+ * second-level index is the next SL_INDEX_BITS bits below the leading one;
+ * anything past the last first-level range is clamped into the last class.
+ */
+static inline int size_class(long size) {
+   assert(size >= MINBLOCKSIZE);
+
+   int fl = (int)(8 * sizeof(long)) - 1 - __builtin_clzl(size);
+   if (fl >= FL_MIN_SHIFT + FL_COUNT) { //clamps huge blocks into the last list
+      return NUM_SIZE_CLASSES - 1;
+   }
+   int sl = (size >> (fl - SL_INDEX_BITS)) & (SL_COUNT - 1);
+   return (fl - FL_MIN_SHIFT) * SL_COUNT + sl;
+}
+
+/*
+ * next_free_class:
+ * returns the smallest size class at or above 'class' whose free list is
+ * non-empty, or -1 if there is none. Only looks at the bitmaps, so this takes
+ * constant time no matter how many blocks are free.
+ */
+static inline int next_free_class(int class) {
+   assert(class >= 0 && class < NUM_SIZE_CLASSES);
+
+   int fl = class / SL_COUNT;
+   unsigned int sl_map = findex->sl_bitmap[fl] & (~0U << (class % SL_COUNT));
+   if (sl_map == 0) { //nothing left in this range, so look at larger ranges
+      unsigned int fl_map = findex->fl_bitmap & ~((2U << fl) - 1);
+      if (fl_map == 0) {
+         return -1;
+      }
+      fl = __builtin_ctz(fl_map);
+      sl_map = findex->sl_bitmap[fl];
+   }
+   return fl * SL_COUNT + __builtin_ctz(sl_map);
+}
+
+/*
+ * The large free blocks form a treap: a binary search tree ordered by
+ * (size, address) that is kept balanced by giving each node a pseudo-random
+ * priority and keeping every parent's priority above its children's. The
+ * priority is a hash of the block's address, so nothing extra is stored. For
+ * a free block in the tree:
+ *     payload[0] is the block's left child
+ *     payload[1] is the block's right child
+ *     payload[2] is the block's parent (NULL for the root)
+ */
+
+/*
+ * tree_left/tree_right/tree_parent:
+ * return the given link of a free block in the tree
+ */
+static inline block_t *tree_left(block_t *b) {
+   assert(!block_allocated(b));
+
+   return (block_t *)b->payload[0];
+}
+
+static inline block_t *tree_right(block_t *b) {
+   assert(!block_allocated(b));
+
+   return (block_t *)b->payload[1];
+}
+
+static inline block_t *tree_parent(block_t *b) {
+   assert(!block_allocated(b));
+
+   return (block_t *)b->payload[2];
+}
+
+/*
+ * tree_set_left/tree_set_right/tree_set_parent:
+ * set the given link of a free block in the tree
+ */
+static inline void tree_set_left(block_t *b, block_t *left) {
+   assert(!block_allocated(b));
+
+   b->payload[0] = (long)left;
+}
+
+static inline void tree_set_right(block_t *b, block_t *right) {
+   assert(!block_allocated(b));
+
+   b->payload[1] = (long)right;
+}
+
+static inline void tree_set_parent(block_t *b, block_t *parent) {
+   assert(!block_allocated(b));
+
+   b->payload[2] = (long)parent;
+}
+
+/*
+ * tree_priority:
+ * returns the heap priority of a tree node, a multiplicative hash of its
+ * address (the low bits are always 0, so they are shifted out first)
+ */
+static inline unsigned long tree_priority(block_t *b) {
+
+   return ((unsigned long)b >> 3) * 0x9E3779B97F4A7C15UL;
+}
+
+/*
+ * tree_before:
+ * returns 1 if a orders before b in the tree, i.e. a is smaller, or the
+ * same size and at a lower address
+ */
+static inline int tree_before(block_t *a, block_t *b) {
+
+   if (block_size(a) != block_size(b)) {
+      return block_size(a) < block_size(b);
+   }
+   return a < b;
+}
+
+/*
+ * tree_replace_child:
+ * makes new_child take old_child's place under parent (or at the root)
+ */
+static inline void tree_replace_child(block_t *parent, block_t *old_child,
+                                      block_t *new_child) {
+
+   if (parent == NULL) {
+      findex->ftree_root = new_child;
+   } else if (tree_left(parent) == old_child) {
+      tree_set_left(parent, new_child);
+   } else {
+      tree_set_right(parent, new_child);
+   }
+   if (new_child != NULL) {
+      tree_set_parent(new_child, parent);
+   }
+}
+
+/*
+ * tree_rotate_up:
+ * rotates b above its parent, keeping the tree's ordering
+ */
+static inline void tree_rotate_up(block_t *b) {
+   block_t *parent = tree_parent(b);
+   assert(parent != NULL);
+
+   tree_replace_child(tree_parent(parent), parent, b);
+   if (tree_left(parent) == b) { //b was the left child
+      block_t *moved = tree_right(b);
+      tree_set_left(parent, moved);
+      if (moved != NULL) {
+         tree_set_parent(moved, parent);
+      }
+      tree_set_right(b, parent);
+   } else { //b was the right child
+      block_t *moved = tree_left(b);
+      tree_set_right(parent, moved);
+      if (moved != NULL) {
+         tree_set_parent(moved, parent);
+      }
+      tree_set_left(b, parent);
+   }
+   tree_set_parent(parent, b);
+}
+
+/*
+ * tree_insert:
+ * inserts a free block into the tree of large free blocks
+ */
+static inline void tree_insert(block_t *fb) {
+   assert(!block_allocated(fb));
+
+   block_t *parent = NULL;
+   block_t *cur = findex->ftree_root;
+   while (cur != NULL) { //walks down to the leaf position for fb
+      parent = cur;
+      cur = tree_before(fb, cur) ? tree_left(cur) : tree_right(cur);
+   }
+   tree_set_left(fb, NULL);
+   tree_set_right(fb, NULL);
+   tree_set_parent(fb, parent);
+   if (parent == NULL) {
+      findex->ftree_root = fb;
+   } else if (tree_before(fb, parent)) {
+      tree_set_left(parent, fb);
+   } else {
+      tree_set_right(parent, fb);
+   }
+
+   //restores the heap order on priorities
+   while (tree_parent(fb) != NULL &&
+          tree_priority(fb) > tree_priority(tree_parent(fb))) {
+      tree_rotate_up(fb);
+   }
+}
+
+/*
+ * tree_remove:
+ * removes a free block from the tree of large free blocks
+ */
+static inline void tree_remove(block_t *fb) {
+   assert(!block_allocated(fb));
+
+   //rotates fb down until it has at most one child
+   while (tree_left(fb) != NULL && tree_right(fb) != NULL) {
+      block_t *left = tree_left(fb);
+      block_t *right = tree_right(fb);
+      tree_rotate_up(tree_priority(left) > tree_priority(right) ? left
+                                                                : right);
+   }
+   block_t *child = tree_left(fb) != NULL ? tree_left(fb) : tree_right(fb);
+   tree_replace_child(tree_parent(fb), fb, child);
+}
+
+/*
+ * tree_best_fit:
+ * returns the smallest free block in the tree that is at least size bytes
+ * (the lowest addressed one if there are several), or NULL if none is
+ */
+static inline block_t *tree_best_fit(long size) {
+   block_t *best = NULL;
+   block_t *cur = findex->ftree_root;
+   while (cur != NULL) {
+      if (block_size(cur) >= size) { //fits, but a smaller one may be left
+         best = cur;
+         cur = tree_left(cur);
+      } else {
+         cur = tree_right(cur);
+      }
+   }
+   return best;
+}
+
+#if ADDRESS_ORDERED
+/*
+ * In address-ordered mode, a free block of class c is on levels 1 to
+ * skip_height(b) of c's skip list as well as in the free list itself (level
+ * 0). Level k only has forward links, each a 32-bit offset from findex->base
+ * (0 ends the level), kept in the 32-bit slot skip_slot(b, k). Level 1 uses
+ * the low half of payload[0] and level k > 1 the k-th half word, so every
+ * link stays clear of the blink and the end tag, and inside the first
+ * FREE_LINK_WORDS words.
+ */
+
+/*
+ * skip_slot:
+ * returns a pointer to b's forward link on the given level
+ */
+static inline int *skip_slot(block_t *b, int level) {
+   assert(level >= 1 && level <= SKIP_LEVELS);
+
+   return &((int *)b->payload)[level == 1 ? 0 : level];
+}
+
+/*
+ * skip_height:
+ * returns the highest skip list level b is on: a quarter of the blocks reach
+ * each next level, going by a hash of b's address, but only as far as b has
+ * room for the links (none for a 16-byte block, one for a 24-byte block)
+ */
+static inline int skip_height(block_t *b) {
+   int height = __builtin_clzl(tree_priority(b) | 1) / 2;
+   // half words before the end tag, minus the one holding the blink
+   long room = 2 * (block_size(b) / WORD_SIZE - 2) - 1;
+   if (height > room) {
+      height = room < 0 ? 0 : room;
+   }
+   return height > SKIP_LEVELS ? SKIP_LEVELS : height;
+}
+
+/*
+ * skip_next:
+ * returns the block after b on the given level, or NULL if b is the last
+ */
+static inline block_t *skip_next(block_t *b, int level) {
+   int offset = *skip_slot(b, level);
+
+   return offset == 0 ? NULL : (block_t *)(findex->base + offset);
+}
+
+/*
+ * skip_preds:
+ * fills pred[k - 1] with the last block before fb on level k of the skip
+ * list over class, for every level, or NULL if no block on that level is
+ * before fb
+ */
+static inline void skip_preds(block_t *fb, int class, block_t **pred) {
+   block_t *p = NULL;
+   for (int k = SKIP_LEVELS; k >= 1; k--) {
+      block_t *next = p == NULL ? findex->skip_first[class][k - 1]
+                                : skip_next(p, k);
+      while (next != NULL && next < fb) { //p is on every lower level too
+         p = next;
+         next = skip_next(p, k);
+      }
+      pred[k - 1] = p;
+   }
+}
+#endif
+
+#if SIZE_INDEX
+/**
+ * returns a mask of which of the 8 sizes starting at sizes are at least size:
+ * bit i is set iff sizes[i] >= size. size must be positive (so unused slots
+ * never fit) and smaller than LARGE_BLOCK_SIZE.
+ */
+static inline unsigned int size_index_fits(const int *sizes, long size) {
+#if defined(__AVX2__)
+   __m256i need = _mm256_set1_epi32((int)size - 1);
+   __m256i have = _mm256_loadu_si256((const __m256i *)sizes);
+   return (unsigned int)_mm256_movemask_ps(
+         _mm256_castsi256_ps(_mm256_cmpgt_epi32(have, need)));
+#elif defined(__SSE2__)
+   __m128i need = _mm_set1_epi32((int)size - 1);
+   __m128i lo = _mm_loadu_si128((const __m128i *)sizes);
+   __m128i hi = _mm_loadu_si128((const __m128i *)(sizes + 4));
+   unsigned int mask =
+         _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(lo, need)));
+   return mask |
+         _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(hi, need))) << 4;
+#else
+   unsigned int mask = 0;
+   for (int i = 0; i < 8; i++) {
+      mask |= (unsigned int)(sizes[i] >= size) << i;
+   }
+   return mask;
+#endif
+}
+
+/**
+ * refills the size index of a class from its list, leaving out skip (which
+ * is about to be pulled, or NULL). The list must hold SIZE_INDEX_SLOTS blocks
+ * other than skip.
+ */
+static inline void size_index_rebuild(int class, block_t *skip) {
+   block_t *cur = findex->flist_first[class];
+   for (int i = SIZE_INDEX_SLOTS - 1; i >= 0; cur = block_flink(cur)) {
+      if (cur != skip) {
+         findex->index_size[class][i] = (int)block_size(cur);
+         findex->index_offset[class][i] = (int)((char *)cur - findex->base);
+         i--;
+      }
+   }
+}
+
+/**
+ * adds fb, which just became the head of its class's list, to the class's
+ * size index
+ */
+static inline void size_index_insert(block_t *fb, int class) {
+   int n = findex->index_count[class]++;
+   if (n < SIZE_INDEX_SLOTS) { //past that, the class is walked instead
+      findex->index_size[class][n] = (int)block_size(fb);
+      findex->index_offset[class][n] = (int)((char *)fb - findex->base);
+   }
+}
+
+/**
+ * removes fb from its class's size index, keeping the others in list order.
+ * NOTE: fb must still be on the list
+ */
+static inline void size_index_pull(block_t *fb, int class) {
+   int n = findex->index_count[class]--;
+   if (n > SIZE_INDEX_SLOTS) {
+      if (n - 1 == SIZE_INDEX_SLOTS) { //the index covers the class again
+         size_index_rebuild(class, fb);
+      }
+      return;
+   }
+   int *sizes = findex->index_size[class];
+   int *offsets = findex->index_offset[class];
+   int offset = (int)((char *)fb - findex->base);
+   int i = n - 1;
+   while (offsets[i] != offset) { //newer blocks are pulled more often
+      i--;
+   }
+   memmove(&sizes[i], &sizes[i + 1], (n - 1 - i) * sizeof(int));
+   memmove(&offsets[i], &offsets[i + 1], (n - 1 - i) * sizeof(int));
+   sizes[n - 1] = 0;
+}
+#endif
+
 /*
  *
  * . _  __ _ ._.-+-    |,._. _  _     |_ | _  _.;_/
  * |[ )_) (/,[   | ____| [  (/,(/,____[_)|(_)(_.| \
  *
- * insert block into the (circularly doubly linked) free list
- * If the list is not empty, block should be inserted between
- * flist_first and the last block in the list. flist_first
- * should always be set equal to the new block.
+ * insert block into the (circularly doubly linked) free list for its size
+ * class. If the list is not empty, block should be inserted between
+ * the list's first and last blocks. The list's head should always be set
+ * equal to the new block. Large blocks go into the tree instead.
  */
 static inline void insert_free_block(block_t *fb) {
    assert(!block_allocated(fb));
 
-   if (flist_first != NULL) { //checks if free list is empty 
-      block_t *last = block_blink(flist_first);
-      block_set_flink(fb, flist_first);
+   if (block_size(fb) >= LARGE_BLOCK_SIZE) { //large blocks live in the tree
+      tree_insert(fb);
+      return;
+   }
+
+   int class = size_class(block_size(fb));
+   block_t **head = &findex->flist_first[class];
+#if SIZE_INDEX
+   size_index_insert(fb, class);
+#endif
+#if ADDRESS_ORDERED
+   block_t *pred[SKIP_LEVELS];
+   skip_preds(fb, class, pred);
+   for (int k = 1; k <= skip_height(fb); k++) {
+      block_t **link = pred[k - 1] == NULL ? &findex->skip_first[class][k - 1]
+                                           : NULL;
+      block_t *next = link != NULL ? *link : skip_next(pred[k - 1], k);
+      *skip_slot(fb, k) = next == NULL ? 0 : (int)((char *)next - findex->base);
+      if (link != NULL) {
+         *link = fb;
+      } else {
+         *skip_slot(pred[k - 1], k) = (int)((char *)fb - findex->base);
+      }
+   }
+   if (*head != NULL && *head < fb) { //goes after the last block below it
+      block_t *prev = pred[0] == NULL ? *head : pred[0];
+      while (block_flink(prev) != *head && block_flink(prev) < fb) {
+         prev = block_flink(prev);
+      }
+      block_t *next = block_flink(prev);
+      block_set_flink(fb, next);
+      block_set_blink(fb, prev);
+      block_set_flink(prev, fb);
+      block_set_blink(next, fb);
+      return;
+   }
+#endif
+   if (*head != NULL) { //checks if free list is empty 
+      block_t *last = block_blink(*head);
+      block_set_flink(fb, *head);
       block_set_blink(fb, last);
       block_set_flink(last, fb);
-      block_set_blink(flist_first, fb);
+      block_set_blink(*head, fb);
    } else { //check if free list is not empty 
       block_set_flink(fb, fb);
       block_set_blink(fb, fb);
+      findex->fl_bitmap |= 1U << (class / SL_COUNT);
+      findex->sl_bitmap[class / SL_COUNT] |= 1U << (class % SL_COUNT);
    }
-   flist_first = fb;
+   *head = fb;
 }
 
 /**
@@ -362,19 +931,51 @@ static inline void insert_free_block(block_t *fb) {
  * [_)(_|||____| [  (/,(/,____[_)|(_)(_.| \
  * |
  *
- * pull a block from the (circularly doubly linked) free list
+ * pull a block from the (circularly doubly linked) free list for its size
+ * class (or from the tree, for large blocks). NOTE: the block's size must not
+ * have changed since it was inserted, otherwise the wrong list is searched
  */
 static inline void pull_free_block(block_t *fb) {
    assert(!block_allocated(fb));
 
-   if (flist_first == NULL) { //checks if free list is empty 
+   if (block_size(fb) >= LARGE_BLOCK_SIZE) { //large blocks live in the tree
+      tree_remove(fb);
+      return;
+   }
+
+   int class = size_class(block_size(fb));
+   block_t **head = &findex->flist_first[class];
+   if (*head == NULL) { //checks if free list is empty 
        return;
    }
+#if SIZE_INDEX
+   size_index_pull(fb, class);
+#endif
+#if ADDRESS_ORDERED
+   if (skip_height(fb) > 0) { //unlinks fb from the skip list levels it is on
+      block_t *pred[SKIP_LEVELS];
+      skip_preds(fb, class, pred);
+      for (int k = 1; k <= skip_height(fb); k++) {
+         if (pred[k - 1] == NULL) {
+            findex->skip_first[class][k - 1] = skip_next(fb, k);
+         } else {
+            *skip_slot(pred[k - 1], k) = *skip_slot(fb, k);
+         }
+      }
+   }
+#endif
    int first = 0;
 
-   if (flist_first == fb) { //check if fb is first element in free list 
+   if (*head == fb) { //check if fb is first element in free list 
        if (block_flink(fb) == fb && block_blink(fb) == fb) { //checks if fb is the only block in free list
-           flist_first = NULL;
+           *head = NULL;
+#if PLACEMENT == FIT_NEXT
+           findex->rover[class] = NULL;
+#endif
+           findex->sl_bitmap[class / SL_COUNT] &= ~(1U << (class % SL_COUNT));
+           if (findex->sl_bitmap[class / SL_COUNT] == 0) { //range is now empty
+               findex->fl_bitmap &= ~(1U << (class / SL_COUNT));
+           }
            return;
        }
        first = 1; //setting a flag if fb is first 
@@ -384,9 +985,14 @@ static inline void pull_free_block(block_t *fb) {
    block_t *next = block_flink(fb);
    block_set_blink(next, prev);
    block_set_flink(prev, next);
+#if PLACEMENT == FIT_NEXT
+   if (findex->rover[class] == fb) { //the rover moves on past fb
+      findex->rover[class] = next;
+   }
+#endif
 
    if (first == 1) { //checks if fb is first 
-       flist_first = next;
+       *head = next;
    }
 }
 
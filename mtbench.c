@@ -0,0 +1,310 @@
+/*
+ * mtbench.c - replays a trace file from several threads at once against
+ * the mm.c allocator and reports throughput for each thread count.
+ *
+ * Every thread replays its own copy of the trace (with its own block ids)
+ * repeatedly, so all threads share the allocator behind mm_malloc, mm_free
+ * and mm_realloc. On a machine with at least as many cores as threads, a
+ * speedup close to the thread count means the threads rarely wait on each
+ * other.
+ *
+ * With -p, it instead runs producer/consumer pairs: each producer allocates
+ * messages and hands them over a queue to its consumer, which frees them, so
+ * every free is a cross-thread free.
+ *
+ * usage: mtbench [-f <file>] [-t <max threads>] [-n <repetitions>] [-p]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./memlib.h"
+#include "./mm.h"
+
+#define MAXLINE 1024
+#define MAX_THREADS 64
+#define MESSAGES 200000 /* messages sent by each producer */
+#define QUEUE_SIZE 1024 /* messages in flight between a producer/consumer */
+
+typedef enum { ALLOC, FREE, REALLOC } op_type_t;
+
+typedef struct {
+    op_type_t type; /* type of request */
+    int index;      /* index of the block this request is about */
+    int size;       /* byte size of alloc/realloc request */
+} op_t;
+
+typedef struct {
+    int num_ids; /* number of distinct block ids in the trace */
+    int num_ops; /* number of requests in the trace */
+    op_t *ops;   /* the requests, in order */
+} trace_t;
+
+typedef struct {
+    trace_t *trace;
+    int reps;   /* how many times to replay the trace */
+    int failed; /* set if mm_malloc or mm_realloc returned NULL */
+} worker_t;
+
+/* a single-producer, single-consumer ring of messages */
+typedef struct {
+    char *slots[QUEUE_SIZE];
+    unsigned long head; /* next slot to read, only written by the consumer */
+    unsigned long tail; /* next slot to write, only written by the producer */
+} queue_t;
+
+static void app_error(char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+/* reads a trace file in the format used by mdriver */
+static trace_t *read_trace(char *path) {
+    FILE *f;
+    char type[MAXLINE];
+    int heap_size, weight, index, size;
+    trace_t *trace = malloc(sizeof(trace_t));
+
+    if (trace == NULL) app_error("malloc failed in read_trace");
+    if ((f = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    if (fscanf(f, "%d %d %d %d", &heap_size, &trace->num_ids, &trace->num_ops,
+               &weight) != 4)
+        app_error("malformed trace header");
+    trace->ops = malloc(trace->num_ops * sizeof(op_t));
+    if (trace->ops == NULL) app_error("malloc failed in read_trace");
+
+    for (int i = 0; i < trace->num_ops; i++) {
+        if (fscanf(f, "%s", type) != 1) app_error("truncated trace");
+        switch (type[0]) {
+            case 'a':
+            case 'r':
+                if (fscanf(f, "%d %d", &index, &size) != 2)
+                    app_error("malformed request");
+                trace->ops[i].type = type[0] == 'a' ? ALLOC : REALLOC;
+                trace->ops[i].size = size;
+                break;
+            case 'f':
+                if (fscanf(f, "%d", &index) != 1)
+                    app_error("malformed request");
+                trace->ops[i].type = FREE;
+                break;
+            default:
+                app_error("bogus request type in trace");
+        }
+        trace->ops[i].index = index;
+    }
+    fclose(f);
+    return trace;
+}
+
+/* replays the trace reps times; run by every thread */
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    trace_t *trace = w->trace;
+    char **blocks = calloc(trace->num_ids, sizeof(char *));
+
+    if (blocks == NULL) app_error("calloc failed in worker");
+    for (int r = 0; r < w->reps && !w->failed; r++) {
+        for (int i = 0; i < trace->num_ops; i++) {
+            op_t *op = &trace->ops[i];
+            switch (op->type) {
+                case ALLOC:
+                    blocks[op->index] = mm_malloc(op->size);
+                    break;
+                case REALLOC:
+                    blocks[op->index] =
+                        mm_realloc(blocks[op->index], op->size);
+                    break;
+                case FREE:
+                    mm_free(blocks[op->index]);
+                    blocks[op->index] = NULL;
+                    continue;
+            }
+            if (blocks[op->index] == NULL) {
+                w->failed = 1;
+                break;
+            }
+            /* touch the block so the cache behavior is realistic */
+            blocks[op->index][0] = (char)i;
+        }
+    }
+    for (int i = 0; i < trace->num_ids; i++) {
+        mm_free(blocks[i]);
+    }
+    free(blocks);
+    return NULL;
+}
+
+/* allocates MESSAGES messages and sends them to the consumer */
+static void *producer(void *arg) {
+    queue_t *q = arg;
+    unsigned int seed = 1;
+
+    for (unsigned long i = 0; i < MESSAGES; i++) {
+        seed = seed * 1103515245 + 12345;
+        int size = 16 + (seed >> 16) % 497; /* 16 to 512 bytes */
+        char *msg = mm_malloc(size);
+        if (msg == NULL) app_error("mm_malloc failed in producer");
+        msg[0] = (char)i;
+        while (i - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) >= QUEUE_SIZE)
+            sched_yield(); /* queue is full */
+        q->slots[i % QUEUE_SIZE] = msg;
+        __atomic_store_n(&q->tail, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* receives MESSAGES messages from the producer and frees them */
+static void *consumer(void *arg) {
+    queue_t *q = arg;
+
+    for (unsigned long i = 0; i < MESSAGES; i++) {
+        while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == i)
+            sched_yield(); /* queue is empty */
+        char *msg = q->slots[i % QUEUE_SIZE];
+        if (msg[0] != (char)i) app_error("message corrupted in transit");
+        mm_free(msg);
+        __atomic_store_n(&q->head, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* runs npairs producer/consumer pairs and returns the elapsed wall time */
+static double run_pairs(int npairs) {
+    pthread_t threads[MAX_THREADS];
+    queue_t *queues = calloc(npairs, sizeof(queue_t));
+    struct timespec start, end;
+
+    if (queues == NULL) app_error("calloc failed in run_pairs");
+    mem_reset_brk();
+    if (mm_init() < 0) app_error("mm_init failed");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < npairs; i++) {
+        if (pthread_create(&threads[2 * i], NULL, producer, &queues[i]) != 0 ||
+            pthread_create(&threads[2 * i + 1], NULL, consumer, &queues[i]) !=
+                0)
+            app_error("pthread_create failed");
+    }
+    for (int i = 0; i < 2 * npairs; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(queues);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/* runs the trace on nthreads threads and returns the elapsed wall time */
+static double run(trace_t *trace, int nthreads, int reps, int *failed) {
+    pthread_t threads[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    struct timespec start, end;
+
+    mem_reset_brk();
+    if (mm_init() < 0) app_error("mm_init failed");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].trace = trace;
+        workers[i].reps = reps;
+        workers[i].failed = 0;
+        if (pthread_create(&threads[i], NULL, worker, &workers[i]) != 0)
+            app_error("pthread_create failed");
+    }
+    *failed = 0;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        *failed |= workers[i].failed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: mtbench [-f <file>] [-t <max threads>] [-n <reps>] "
+            "[-p]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-f <file>  Trace file to replay.\n");
+    fprintf(stderr, "\t-t <n>     Largest thread count to try (default 8).\n");
+    fprintf(stderr, "\t-n <n>     Replays of the trace per thread.\n");
+    fprintf(stderr, "\t-p         Run producer/consumer pairs instead.\n");
+}
+
+int main(int argc, char **argv) {
+    char *path = "./traces/binary-bal.rep";
+    int max_threads = 8;
+    int reps = 20;
+    int pairs = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:t:n:ph")) != EOF) {
+        switch (c) {
+            case 'f':
+                path = optarg;
+                break;
+            case 't':
+                max_threads = atoi(optarg);
+                break;
+            case 'n':
+                reps = atoi(optarg);
+                break;
+            case 'p':
+                pairs = 1;
+                break;
+            default:
+                usage();
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (max_threads < 1 || max_threads > MAX_THREADS || reps < 1) {
+        usage();
+        exit(1);
+    }
+
+    mem_init();
+    if (pairs) {
+        printf("producer/consumer: %d messages per pair\n", MESSAGES);
+        printf("threads  secs       Kmsgs/sec speedup\n");
+        double base = 0;
+        for (int t = 2; t <= max_threads; t *= 2) {
+            double secs = run_pairs(t / 2);
+            double kmsgs = (double)MESSAGES * (t / 2) / secs / 1e3;
+            if (t == 2) {
+                base = kmsgs;
+            }
+            printf("%-8d %-10.6f %-9.0f %.2fx\n", t, secs, kmsgs,
+                   kmsgs / base);
+        }
+        mem_deinit();
+        return 0;
+    }
+
+    trace_t *trace = read_trace(path);
+
+    printf("%s: %d ops x %d reps per thread\n", path, trace->num_ops, reps);
+    printf("threads  secs       Kops/sec  speedup\n");
+    double base = 0;
+    for (int t = 1; t <= max_threads; t *= 2) {
+        int failed;
+        double secs = run(trace, t, reps, &failed);
+        double kops = (double)trace->num_ops * reps * t / secs / 1e3;
+        if (t == 1) {
+            base = kops;
+        }
+        printf("%-8d %-10.6f %-9.0f %.2fx%s\n", t, secs, kops, kops / base,
+               failed ? "  (ran out of memory)" : "");
+    }
+
+    mem_deinit();
+    free(trace->ops);
+    free(trace);
+    return 0;
+}
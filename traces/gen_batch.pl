@@ -0,0 +1,58 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+# Models request handlers that each allocate a batch of same-sized nodes
+# and later free the whole batch together, in allocation order.
+
+$out_filename = "batch.rep";
+$num_requests = 500;   # batches allocated
+$max_live = 8;         # batches live at once
+@sizes = (16, 24, 40, 64, 96, 200, 480);
+
+srand(330);
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+$id = 0;
+$peak = 0;
+$live_bytes = 0;
+for ($r = 0; $r < $num_requests; $r += 1) {
+    $n = 8 + int(rand 41);
+    $size = $sizes[int(rand @sizes)];
+    @batch = ();
+    for ($i = 0; $i < $n; $i += 1) {
+        push @ops, "a $id $size";
+        push @batch, $id;
+        $id += 1;
+    }
+    push @live, [$size, @batch];
+    $live_bytes += $n * $size;
+    $peak = $live_bytes if $live_bytes > $peak;
+    if (@live > $max_live) {
+        # the oldest request is done, so its nodes go back together
+        $old = shift @live;
+        $old_size = shift @$old;
+        foreach $f (@$old) {
+            push @ops, "f $f";
+        }
+        $live_bytes -= $old_size * @$old;
+    }
+}
+foreach $old (@live) {
+    shift @$old;
+    foreach $f (@$old) {
+        push @ops, "f $f";
+    }
+}
+
+$num_ops = @ops;
+print OUTFILE $peak + 100, "\n";
+print OUTFILE "$id\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+foreach $op (@ops) {
+    print OUTFILE "$op\n";
+}
+
+close OUTFILE;